@@ -0,0 +1,93 @@
+#!/bin/bash
+#
+# bench.sh - time cower against a local mock of the AUR
+#
+# usage: bench.sh [path to cower] [local db path]
+#
+# Each scenario runs against bench/mockaur.py with --stats, in a scratch
+# HOME so no config, cache or daemon of the user's gets involved. The -u
+# scenario needs a cower built to read its local db from the given path
+# (see `make bench`). That db is filled with packages for it to update.
+# Tunables come from the environment:
+#
+#   BENCH_LATENCY   per-request latency in milliseconds (default: 20)
+#   BENCH_PACKAGES  packages for the -u and -ii scenarios (default: 500)
+#   BENCH_RESULTS   results for each search (default: 10000)
+#   BENCH_DEPTH     levels in the -dd dependency tree (default: 6)
+#   BENCH_FANOUT    depends per package in that tree (default: 2)
+#   BENCH_STATS     --stats format, text or json (default: text)
+#
+
+cower=$(realpath "${1:-./cower}")
+dbpath=$2
+benchdir=$(dirname "$(realpath "$0")")
+
+: "${BENCH_LATENCY:=20}"
+: "${BENCH_PACKAGES:=500}"
+: "${BENCH_RESULTS:=10000}"
+: "${BENCH_DEPTH:=6}"
+: "${BENCH_FANOUT:=2}"
+: "${BENCH_STATS:=text}"
+
+if [[ ! -x $cower ]]; then
+  printf 'error: %s is not executable. build cower first\n' "$cower" >&2
+  exit 1
+fi
+
+scratch=$(mktemp -d)
+trap 'kill $server 2>/dev/null; wait $server 2>/dev/null; rm -rf "$scratch"' EXIT
+
+python3 "$benchdir/mockaur.py" --port-file "$scratch/port" \
+    --latency "$BENCH_LATENCY" --results "$BENCH_RESULTS" \
+    --depth "$BENCH_DEPTH" --fanout "$BENCH_FANOUT" &
+server=$!
+
+for (( i = 0; i < 50; i++ )); do
+  [[ -s $scratch/port ]] && break
+  sleep 0.1
+done
+if [[ ! -s $scratch/port ]]; then
+  echo 'error: mock server failed to start' >&2
+  exit 1
+fi
+aururl=http://127.0.0.1:$(<"$scratch/port")
+
+# every scenario starts cold: no config, no RPC or tarball cache, no daemon
+run() {
+  local name=$1; shift
+  local home=$scratch/home-$name
+
+  mkdir -p "$home/dl"
+  printf '\n==> %s: cower %s\n' "$name" "$*" >&2
+  HOME=$home XDG_CONFIG_HOME=$home/.config XDG_CACHE_HOME=$home/.cache \
+      XDG_RUNTIME_DIR=$home TMPDIR=$home \
+      "$cower" --aur-url "$aururl" --stats="$BENCH_STATS" -t "$home/dl" "$@" >/dev/null
+}
+
+targets=()
+for (( i = 0; i < BENCH_PACKAGES; i++ )); do
+  targets+=("pkg-$i")
+done
+
+# -u only looks at installed packages. with no sync dbs configured, every
+# package in this db is foreign, and the mock has an update for all of them
+if [[ $dbpath ]]; then
+  rm -rf "$dbpath/local"
+  mkdir -p "$dbpath/local" "$dbpath/sync"
+  echo 9 >"$dbpath/local/ALPM_DB_VERSION"
+  for pkg in "${targets[@]}"; do
+    mkdir "$dbpath/local/$pkg-1.0-1"
+    printf '%%NAME%%\n%s\n\n%%VERSION%%\n1.0-1\n\n' "$pkg" \
+        >"$dbpath/local/$pkg-1.0-1/desc"
+    : >"$dbpath/local/$pkg-1.0-1/files"
+  done
+  run update -u
+else
+  printf '\n==> update: skipped, no local db given\n' >&2
+fi
+
+run search -s bench
+run depends -ddf dep0x0
+run extinfo -ii "${targets[@]}"
+
+exit 0
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+#
+# mockaur.py - a stand-in for the AUR, for benchmarking cower
+#
+# Serves canned RPC JSON, PKGBUILDs and tarballs for any package name that's
+# asked for, so cower can be pointed at it with --aur-url. Nothing is read
+# from disk. Package names decide what's served:
+#
+#   dep<L>x<I>   depends on dep<L+1>x<I*F> .. dep<L+1>x<I*F+F-1> until level
+#                --depth is reached, which makes -dd walk a tree of --fanout
+#   bulk-*       ships --bulk bytes of incompressible data next to its
+#                PKGBUILD, big enough that extraction falls behind the wire
+#   anything     has no depends
+#
+# searches return --results packages containing the search term.
+#
+
+import argparse
+import email.utils
+import gzip
+import io
+import json
+import random
+import re
+import sys
+import tarfile
+import time
+import urllib.parse
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+DEPNAME = re.compile(r'^dep(\d+)x(\d+)$')
+EPOCH = 1300000000
+
+
+def depends(opts, name):
+    m = DEPNAME.match(name)
+    if not m:
+        return []
+
+    level, idx = int(m.group(1)), int(m.group(2))
+    if level >= opts.depth:
+        return []
+
+    return ['dep%dx%d' % (level + 1, idx * opts.fanout + k)
+            for k in range(opts.fanout)]
+
+
+def pkgbuild(opts, name):
+    deps = ' '.join("'%s'" % d for d in depends(opts, name))
+
+    return ('# generated by mockaur.py\n'
+            'pkgname=%s\n'
+            'pkgver=1.0\n'
+            'pkgrel=1\n'
+            "pkgdesc='benchmark package %s'\n"
+            "arch=('any')\n"
+            "license=('MIT')\n"
+            'depends=(%s)\n'
+            "optdepends=('bash: for the scripts')\n"
+            "provides=('%s-virtual')\n"
+            'package() {\n'
+            '  true\n'
+            '}\n' % (name, name, deps, name)).encode()
+
+
+def tarball(opts, name):
+    files = [('PKGBUILD', pkgbuild(opts, name))]
+    if name.startswith('bulk-'):
+        files.append(('bulk.bin', random.Random(name).randbytes(opts.bulk)))
+
+    # fixed timestamps all the way down, so every fetch gets the same bytes
+    buf = io.BytesIO()
+    with gzip.GzipFile(fileobj=buf, mode='wb', mtime=EPOCH) as gz:
+        with tarfile.open(fileobj=gz, mode='w|') as tar:
+            for path, data in files:
+                info = tarfile.TarInfo('%s/%s' % (name, path))
+                info.size = len(data)
+                info.mtime = EPOCH
+                info.mode = 0o644
+                tar.addfile(info, io.BytesIO(data))
+
+    return buf.getvalue()
+
+
+def pkginfo(name, idx=0):
+    return {
+        'ID': 1000 + idx,
+        'Name': name,
+        'Version': '999-1',
+        'CategoryID': 2,
+        'Description': 'benchmark package %s' % name,
+        'URL': 'https://example.org/%s' % name,
+        'URLPath': '/packages/%s/%s/%s.tar.gz' % (name[:2], name, name),
+        'License': 'MIT',
+        'NumVotes': idx % 500,
+        'OutOfDate': 0,
+        'Maintainer': 'bench',
+        'FirstSubmitted': EPOCH,
+        'LastModified': EPOCH + idx,
+    }
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, fmt, *args):
+        if self.server.opts.verbose:
+            sys.stderr.write('mockaur: %s\n' % (fmt % args))
+
+    def reply(self, body, ctype='application/json'):
+        self.send_response(200)
+        self.send_header('Content-Type', ctype)
+        self.send_header('Content-Length', str(len(body)))
+        self.send_header('Last-Modified', email.utils.formatdate(EPOCH, usegmt=True))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def rpc(self, query):
+        opts = self.server.opts
+        qtype = query.get('type', [''])[0]
+
+        if qtype in ('search', 'msearch'):
+            term = query.get('arg', [''])[0]
+            results = [pkginfo('%s-%d' % (term, i), i) for i in range(opts.results)]
+        elif qtype == 'info':
+            results = pkginfo(query.get('arg', [''])[0])
+        elif qtype == 'multiinfo':
+            results = [pkginfo(n, i) for i, n in enumerate(query.get('arg[]', []))]
+        else:
+            results = 'unknown request type'
+            qtype = 'error'
+
+        count = len(results) if isinstance(results, list) else 1
+        body = json.dumps({'type': qtype, 'resultcount': count, 'results': results})
+        self.reply(body.encode())
+
+    def do_GET(self):
+        opts = self.server.opts
+        url = urllib.parse.urlsplit(self.path)
+        parts = url.path.strip('/').split('/')
+
+        if opts.latency:
+            time.sleep(opts.latency / 1000.0)
+
+        if url.path == '/rpc.php':
+            self.rpc(urllib.parse.parse_qs(url.query))
+        elif len(parts) == 4 and parts[0] == 'packages' and parts[3] == 'PKGBUILD':
+            self.reply(pkgbuild(opts, parts[2]), 'text/plain')
+        elif len(parts) == 4 and parts[0] == 'packages' and parts[3].endswith('.tar.gz'):
+            name = parts[2]
+            if name not in self.server.tarballs:
+                self.server.tarballs[name] = tarball(opts, name)
+            self.reply(self.server.tarballs[name], 'application/x-gzip')
+        elif url.path == '/packages.gz':
+            names = '\n'.join('pkg-%d' % i for i in range(opts.results))
+            self.reply(gzip.compress(names.encode()), 'application/x-gzip')
+        else:
+            self.send_error(404)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='serve a fake AUR for cower benchmarks')
+    parser.add_argument('--port', type=int, default=0,
+                        help='port to listen on (default: any free port)')
+    parser.add_argument('--port-file',
+                        help='write the port actually bound to this file')
+    parser.add_argument('--latency', type=float, default=0,
+                        help='milliseconds to wait before answering each request')
+    parser.add_argument('--results', type=int, default=10000,
+                        help='number of results for every search')
+    parser.add_argument('--depth', type=int, default=6,
+                        help='levels in the dep<L>x<I> dependency tree')
+    parser.add_argument('--fanout', type=int, default=2,
+                        help='depends per package in the dependency tree')
+    parser.add_argument('--bulk', type=int, default=16 * 1024 * 1024,
+                        help='bytes of padding in bulk-* tarballs')
+    parser.add_argument('-v', '--verbose', action='store_true',
+                        help='log every request to stderr')
+    opts = parser.parse_args()
+
+    server = ThreadingHTTPServer(('127.0.0.1', opts.port), Handler)
+    server.daemon_threads = True
+    server.opts = opts
+    server.tarballs = {}
+
+    if opts.port_file:
+        with open(opts.port_file, 'w') as f:
+            f.write('%d\n' % server.server_address[1])
+
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()
@@ -28,16 +28,27 @@
 #define _GNU_SOURCE
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <glob.h>
 #include <locale.h>
 #include <pthread.h>
 #include <pwd.h>
 #include <regex.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <utime.h>
+#include <unistd.h>
 #include <wchar.h>
 #include <wordexp.h>
 
@@ -46,7 +57,7 @@
 #include <archive.h>
 #include <archive_entry.h>
 #include <curl/curl.h>
-#include <openssl/crypto.h>
+#include <yajl/yajl_gen.h>
 #include <yajl/yajl_parse.h>
 
 /* macros {{{ */
@@ -58,7 +69,7 @@
 #define STREQ(x,y)            (strcmp((x),(y)) == 0)
 #define STR_STARTS_WITH(x,y)  (strncmp((x),(y), strlen(y)) == 0)
 #define NCFLAG(val, flag)     (!cfg.color && (val)) ? (flag) : ""
-#define KEY_IS(k)             (strncmp(p->key, (k), p->keysz) == 0)
+#define KEY_IS(k)             (size == sizeof(k) - 1 && memcmp(key, (k), size) == 0)
 
 #ifndef PACMAN_ROOT
 	#define PACMAN_ROOT         "/"
@@ -72,17 +83,45 @@
 
 #define COWER_USERAGENT       "cower/3.x"
 
-#define AUR_BASE_URL          "https://aur.archlinux.org%s"
-#define AUR_PKG_URL_FORMAT    "https://aur.archlinux.org/packages/"
-#define AUR_RPC_URL           "https://aur.archlinux.org/rpc.php?type=%s&arg=%s"
+#define AUR_URL_DEFAULT       "https://aur.archlinux.org"
+#define AUR_BASE_URL          "%s%s"
+#define AUR_PKG_URL_FORMAT    "%s/packages/%s"
+#define AUR_RPC_URL           "%s/rpc.php?type=%s&arg=%s"
+#define AUR_RPC_URL_MULTI     "%s/rpc.php?type=" AUR_QUERY_TYPE_MULTI
+#define AUR_RPC_ARG_MULTI     "&arg%%5B%%5D=%s"
+#define AUR_URL_MAX           4096
+#define AUR_PKGLIST_URL       "%s/packages.gz"
+#define BUFPOOL_MAX           16
+#define BUFPOOL_MAXSIZE       (1024 * 1024)
+#define BUFSIZE_MIN           4096
+#define OUTBUF_FLUSH          (64 * 1024)
+#define FEED_BLOCKSIZE        (64 * 1024)
+#define ARENA_BLOCKSIZE       4096
 #define THREAD_DEFAULT        10
+#define THREAD_MAX            32
+#define PKGBUILD_THREADS      8
+#define RETRY_MAX             3
+#define RETRY_DELAY           0.5
 #define TIMEOUT_DEFAULT       10L
 #define UNSET                 -1
+#define INDEX_FILE            "index"
+#define INDEX_HEADER          "# cower index 1\n"
+#define INDEX_NFIELDS         13
+#define SNAPSHOT_FILE         "updates"
+#define SNAPSHOT_HEADER       "# cower update snapshot 1\n"
+#define TARBALL_DIR           "tarballs"
+#define SOCKET_NAME           "cower.sock"
+#define SERVER_MAGIC          0x636f7701
+#define SERVER_MSG_MAX        (1024 * 1024)
+#define SERVER_DECLINED       -1
+#define STATS_TEXT            1
+#define STATS_JSON            2
 
 #define AUR_QUERY_TYPE        "type"
 #define AUR_QUERY_TYPE_INFO   "info"
 #define AUR_QUERY_TYPE_SEARCH "search"
 #define AUR_QUERY_TYPE_MSRCH  "msearch"
+#define AUR_QUERY_TYPE_MULTI  "multiinfo"
 #define AUR_QUERY_ERROR       "error"
 #define AUR_QUERY_RESULTCOUNT "resultcount"
 
@@ -107,6 +146,14 @@
 #define PKGBUILD_CONFLICTS    "conflicts=("
 #define PKGBUILD_REPLACES     "replaces=("
 
+#define JSON_CONFLICTS        "Conflicts"
+#define JSON_DEPENDS          "Depends"
+#define JSON_INSTALLED        "InstalledVersion"
+#define JSON_MAKEDEPENDS      "MakeDepends"
+#define JSON_OPTDEPENDS       "OptDepends"
+#define JSON_PROVIDES         "Provides"
+#define JSON_REPLACES         "Replaces"
+
 #define PKG_REPO              "Repository"
 #define PKG_AURPAGE           "AUR Page"
 #define PKG_PROVIDES          "Provides"
@@ -172,7 +219,9 @@ typedef enum __operation_t {
 	OP_INFO     = (1 << 1),
 	OP_DOWNLOAD = (1 << 2),
 	OP_UPDATE   = (1 << 3),
-	OP_MSEARCH  = (1 << 4)
+	OP_MSEARCH  = (1 << 4),
+	OP_SYNC     = (1 << 5),
+	OP_SERVE    = (1 << 6)
 } operation_t;
 
 enum {
@@ -184,9 +233,48 @@ enum {
 	OP_THREADS,
 	OP_TIMEOUT,
 	OP_VERSION,
-	OP_NOIGNOREOOD
+	OP_NOIGNOREOOD,
+	OP_CACHETTL,
+	OP_STREAM,
+	OP_JSON,
+	OP_OFFLINE,
+	OP_SYNCINDEX,
+	OP_STATS,
+	OP_AURURL,
+	OP_DAEMON
 };
 
+typedef enum __phase_t {
+	PHASE_ALPM = 0,
+	PHASE_PKGCACHE,
+	PHASE_QUEUE,
+	PHASE_NETWORK,
+	PHASE_JSON,
+	PHASE_PKGBUILD,
+	PHASE_EXTRACT,
+	PHASE_OUTPUT,
+	PHASE_MAX
+} phase_t;
+
+typedef enum __jsonkey_t {
+	JSONKEY_UNKNOWN = 0,
+	JSONKEY_CAT,
+	JSONKEY_DESC,
+	JSONKEY_FIRSTSUB,
+	JSONKEY_ID,
+	JSONKEY_LASTMOD,
+	JSONKEY_LICENSE,
+	JSONKEY_MAINT,
+	JSONKEY_NAME,
+	JSONKEY_OOD,
+	JSONKEY_RESULTCOUNT,
+	JSONKEY_TYPE,
+	JSONKEY_URL,
+	JSONKEY_URLPATH,
+	JSONKEY_VERSION,
+	JSONKEY_VOTES
+} jsonkey_t;
+
 typedef enum __pkgdetail_t {
 	PKGDETAIL_DEPENDS = 0,
 	PKGDETAIL_MAKEDEPENDS,
@@ -209,6 +297,18 @@ struct strings_t {
 	const char *nc;
 };
 
+struct arena_block_t {
+	struct arena_block_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+struct arena_t {
+	struct arena_block_t *blocks;
+	int refcount;
+};
+
 struct aurpkg_t {
 	char *desc;
 	char *lic;
@@ -229,30 +329,115 @@ struct aurpkg_t {
 	alpm_list_t *optdepends;
 	alpm_list_t *provides;
 	alpm_list_t *replaces;
+	struct arena_t *arena;
 };
 
 struct yajl_parser_t {
 	alpm_list_t *pkglist;
 	int resultcount;
 	struct aurpkg_t *aurpkg;
-	char key[32];
-	size_t keysz;
+	struct arena_t *arena;
+	jsonkey_t key;
 	int json_depth;
+	int rpcerror;
 };
 
 struct response_t {
 	char *data;
 	size_t size;
+	size_t capacity;
+};
+
+struct fmtop_t {
+	char conv;
+	int width;
+	int ljust;
+	const char *literal;
+	size_t literalsz;
+};
+
+struct strset_t {
+	char **keys;
+	void **vals;
+	size_t size;
+	size_t count;
+};
+
+struct cache_t {
+	char *path;
+	char *buf;
+	const char *data;
+	size_t size;
+	char *etag;
+	char *lastmod;
+	time_t mtime;
+};
+
+struct snapshot_t {
+	char *localver;
+	char *aurver;
+	time_t lastmod;
+	time_t checked;
+};
+
+struct reqstat_t {
+	char *label;
+	long httpcode;
+	double queued;
+	double dns;
+	double connect;
+	double tls;
+	double ttfb;
+	double total;
+	double bytes;
+};
+
+struct extract_t {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct transfer_t *transfer;
+	char *chunk;
+	size_t chunksz;
+	size_t chunkmax;
+	int started;
+	int full;
+	int handed;
+	int paused;
+	int eof;
+	int finished;
+	char *subdir;
+	int ret;
+	char *tarball;
+	char *partial;
+	FILE *partfp;
+	int resumed;
 };
 
 struct task_t {
-	void *(*threadfn)(CURL*, void*);
+	void (*taskfn)(void*);
 	void (*printfn)(struct aurpkg_t*);
+	int batched;
 };
 
-struct openssl_mutex_t {
-	pthread_mutex_t *lock;
-	long *lock_count;
+struct transfer_t {
+	CURL *curl;
+	char *url;
+	char *label;
+	struct response_t response;
+	struct yajl_handle_t *yajl_hand;
+	struct yajl_parser_t *parse_struct;
+	void (*donefn)(struct transfer_t*, CURLcode);
+	void (*cb)(void*, void*);
+	void *data;
+	struct cache_t *cache;
+	struct curl_slist *headers;
+	struct extract_t *extract;
+	struct transfer_t *next;
+	double queued;
+	double started;
+	double retry_at;
+	int attempts;
 };
 /* }}} */
 
@@ -260,63 +445,194 @@ struct openssl_mutex_t {
 static alpm_list_t *alpm_find_foreign_pkgs(void);
 static alpm_handle_t *alpm_init(void);
 static int alpm_pkg_is_foreign(alpm_pkg_t*);
+static void alpm_provides_free(void);
+static void alpm_provides_init(void);
 static const char *alpm_provides_pkg(const char*);
-static int archive_extract_file(const struct response_t*, char**);
+static int archive_extract_file(struct extract_t*, const char*, char**);
+static void *archive_extract_thread(void*);
+static void archive_extract_free(struct extract_t*);
+static int archive_extract_unchanged(struct archive_entry*);
+static ssize_t archive_read_chunk(struct archive*, void*, const void**);
+static void *arena_alloc(struct arena_t*, size_t);
+static void arena_free(struct arena_t*);
+static struct arena_t *arena_new(void);
+static struct arena_t *arena_ref(struct arena_t*);
+static void arena_release(struct arena_t*);
+static char *arena_strdup(struct arena_t*, const char*);
+static char *arena_strndup(struct arena_t*, const char*, size_t);
 static int aurpkg_cmp(const void*, const void*);
+static int aurpkg_ptrcmp(const void*, const void*);
 static struct aurpkg_t *aurpkg_dup(const struct aurpkg_t*);
 static void aurpkg_free(void*);
 static void aurpkg_free_inner(struct aurpkg_t*);
+static void cache_free(struct cache_t*);
+static int cache_init(void);
+static struct cache_t *cache_load(const char*);
+static void cache_save(const struct cache_t*, const char*, const struct response_t*);
+static char *cache_tarball_path(const struct aurpkg_t*);
+static void cache_tarball_prune(const struct aurpkg_t*, const char*);
+static double clock_now(void);
+static void config_init(void);
+static void aurpkg_extinfo_cb(void*, void*);
+static void aurpkg_get_extinfo(struct aurpkg_t*);
 static CURL *curl_init_easy_handle(CURL*);
-static char *curl_get_url_as_buffer(CURL*, const char*);
+static void curl_buffer_done(struct transfer_t*, CURLcode);
+static void curl_get_url_as_buffer(const char*, void (*)(void*, void*), void*);
+static void curl_get_url_as_pkglist(const char*, const char*, void (*)(void*, void*), void*);
+static void curl_pkglist_done(struct transfer_t*, CURLcode);
+static size_t curl_write_header(char*, size_t, size_t, void*);
+static int curl_write_partial(struct transfer_t*, const void*, size_t);
+static size_t curl_write_archive(void*, size_t, size_t, void*);
 static size_t curl_write_response(void*, size_t, size_t, void*);
 static int cwr_asprintf(char**, const char*, ...) __attribute__((format(printf,2,3)));
 static int cwr_fprintf(FILE*, loglevel_t, const char*, ...) __attribute__((format(printf,3,4)));
 static int cwr_printf(loglevel_t, const char*, ...) __attribute__((format(printf,2,3)));
 static int cwr_vfprintf(FILE*, loglevel_t, const char*, va_list) __attribute__((format(printf,3,0)));
-static void *download(CURL *curl, void*);
-static alpm_list_t *filter_results(alpm_list_t*);
+static void download(void*);
+static void download_done(struct transfer_t*, CURLcode);
+static void download_extracted(const char*, alpm_list_t*, int, const char*);
+static void feed_free(void);
+static void feed_read(void);
+static void download_query_cb(void*, void*);
+static void filter_free(void);
+static int filter_init(void);
+static int filter_pkg(const struct aurpkg_t*);
+static int format_compile(const char*);
+static void format_free(void);
 static char *get_file_as_buffer(const char*);
+static char *get_file_as_map(const char*, size_t*);
 static int getcols(void);
+static int get_cache_path(char *cache_path, size_t pathlen);
 static int get_config_path(char *config_path, size_t pathlen);
+static int get_socket_path(char*, size_t);
 static void indentprint(const char*, int);
+static void index_list_done(struct transfer_t*, CURLcode);
+static int index_parse_record(char*, struct aurpkg_t*);
+static void index_put_string(FILE*, const char*);
+static int index_search(void);
+static int index_sync(void);
+static int index_write(const char*, const alpm_list_t*);
 static int json_end_map(void*);
 static int json_integer(void *ctx, long long);
+static jsonkey_t json_key_lookup(const char*, size_t);
 static int json_map_key(void*, const unsigned char*, size_t);
 static int json_start_map(void*);
 static int json_string(void*, const unsigned char*, size_t);
-static alpm_list_t *load_targets_from_files(alpm_list_t *files);
-static void openssl_crypto_cleanup(void);
-static void openssl_crypto_init(void);
-static unsigned long openssl_thread_id(void) __attribute__ ((const));
-static void openssl_thread_cb(int, int, const char*, int);
-static alpm_list_t *parse_bash_array(alpm_list_t*, char*, pkgdetail_t);
+static void jsongen_integer(const char*, long long);
+static void jsongen_list(const char*, const alpm_list_t*);
+static void jsongen_string(const char*, const char*);
+static int list_add_unique(alpm_list_t**, struct strset_t*, const char*);
+static size_t mbchar_width(const char*, int*);
+static int mkdir_p(char*);
+static void outbuf_flush(void);
+static void outbuf_pad(int);
+static int outbuf_printf(const char*, ...) __attribute__((format(printf,1,2)));
+static void outbuf_putc(char);
+static void outbuf_puts(const char*);
+static void outbuf_write(const char*, size_t);
+static alpm_list_t *parse_bash_array(alpm_list_t*, char*, pkgdetail_t, struct arena_t*);
 static int parse_configfile(void);
 static int parse_options(int, char*[]);
 static int pkg_is_binary(const char *pkg);
-static void pkgbuild_get_extinfo(char*, alpm_list_t**[]);
+static void pkgbuild_get_extinfo(char*, alpm_list_t**[], struct arena_t*);
+static void pkgbuild_scan(char*, alpm_list_t**[], struct arena_t*);
+static void pkgbuilds_collect(void);
+static void pkgbuilds_free(void);
+static void pkgbuilds_join(void);
+static void pkgbuilds_start(alpm_list_t*);
+static void *pkgbuilds_work(void*);
 static int print_escaped(const char*);
 static void print_extinfo_list(alpm_list_t*, const char*, const char*, int);
 static void print_pkg_formatted(struct aurpkg_t*);
 static void print_pkg_info(struct aurpkg_t*);
+static void print_pkg_json(struct aurpkg_t*);
 static void print_pkg_search(struct aurpkg_t*);
 static void print_results(alpm_list_t*, void (*)(struct aurpkg_t*));
-static int read_targets_from_file(FILE *in, alpm_list_t **targets);
-static int resolve_dependencies(CURL*, const char*, const char*);
+static int read_targets_from_file(FILE*, alpm_list_t**, struct strset_t*);
+static void request_free(void);
+static int request_run(void);
+static int resolve_dependencies(const char*, const char*);
+static void response_release(struct response_t*);
+static int response_reserve(struct response_t*, size_t);
+static int server_compatible(void);
+static int server_forward(int, char*[]);
+static void server_handle(int);
+static void server_reload(void);
+static int server_request(const char*, int, char*[]);
+static int server_run(void);
+static void server_signal(int);
+static int server_stale(void);
+static void server_warm(void);
 static int set_working_dir(void);
+static void snapshot_free(void);
+static void snapshot_load(void);
+static void snapshot_record(const alpm_list_t*);
+static alpm_list_t *snapshot_replay(void);
+static void snapshot_save(void);
+static int sock_read(int, void*, size_t);
+static int sock_write(int, const void*, size_t);
+static alpm_list_t *sort_results(alpm_list_t*);
+static void stats_add(phase_t, double);
+static void stats_extract(int);
+static void stats_free(void);
+static void stats_network(double, double);
+static double stats_now(void);
+static void stats_report(void);
+static void stats_report_json(void);
+static void stats_transfer(struct transfer_t*);
+static void stream_drain(void);
+static void stream_pkg(struct aurpkg_t*);
+static unsigned long long strhash(const char*);
 static int strings_init(void);
+static int strset_add(struct strset_t*, const char*);
+static int strset_contains(const struct strset_t*, const char*);
+static void strset_free(struct strset_t*);
+static void *strset_get(const struct strset_t*, const char*);
+static int strset_grow(struct strset_t*);
+static int strset_put(struct strset_t*, const char*, void*);
+static char **strset_slot(const struct strset_t*, const char*);
 static size_t strtrim(char*);
-static void *task_download(CURL*, void*);
-static void *task_query(CURL*, void*);
-static void *task_update(CURL*, void*);
-static void *thread_pool(void*);
+static void *syncindex_build(void*);
+static void syncindex_free(void);
+static void syncindex_start(void);
+static void syncindex_wait(void);
+static void targets_parse(struct response_t*, char*, size_t, alpm_list_t**,
+		struct strset_t*);
+static void task_download(void*);
+static void task_multiinfo(void*);
+static void task_multiinfo_cb(void*, void*);
+static void task_query(void*);
+static void task_query_cb(void*, void*);
+static void task_update(void*);
+static void task_update_cb(void*, void*);
+static void transfer_adjust(struct transfer_t*, int);
+static void transfer_cleanup(void);
+static void transfer_free(struct transfer_t*);
+static int transfer_init(void);
+static int transfer_is_transient(CURLcode, long);
+static int transfer_limit(void);
+static int transfer_loop(struct task_t*);
+static struct transfer_t *transfer_new(const char*, const char*,
+		void (*)(struct transfer_t*, CURLcode));
+static int transfer_retry(struct transfer_t*, CURLcode);
+static void transfer_share_lock(CURL*, curl_lock_data, curl_lock_access, void*);
+static void transfer_share_unlock(CURL*, curl_lock_data, void*);
+static void transfer_start(struct transfer_t*);
+static void transfer_wake_drain(struct transfer_t*);
+static void transfer_wakeup(struct transfer_t*);
+static char unescape_char(char);
 static char *url_escape(char*, int, const char*);
+static char *url_multiinfo(const alpm_list_t*);
 static void usage(void);
 static void version(void);
+static alpm_list_t *workq_pop_batch(void);
+static void workq_push(char*);
 static size_t yajl_parse_stream(void*, size_t, size_t, void*);
 /* }}} */
 
 /* runtime configuration {{{ */
 static struct {
+	char *aururl;
 	char *dlpath;
 	const char *delim;
 	const char *format;
@@ -326,18 +642,25 @@ static struct {
 
 	short color;
 	short ignoreood;
+	short stats;
 	int extinfo:1;
 	int force:1;
 	int getdeps:1;
 	int quiet:1;
 	int skiprepos:1;
 	int frompkgbuild:1;
+	int stream:1;
+	int json:1;
+	int offline:1;
+	char jsondelim;
 	int maxthreads;
 	long timeout;
+	long cachettl;
+	char *cachedir;
 
 	alpm_list_t *targets;
 	struct {
-	  alpm_list_t *pkgs;
+	  struct strset_t pkgs;
 	  alpm_list_t *repos;
 	} ignore;
 } cfg; /* }}} */
@@ -347,8 +670,154 @@ struct strings_t *colstr;
 alpm_handle_t *pmhandle;
 alpm_db_t *db_local;
 alpm_list_t *workq;
-struct openssl_mutex_t openssl_lock;
-static pthread_mutex_t listlock = PTHREAD_MUTEX_INITIALIZER;
+alpm_list_t *results;
+
+/* mirrors cfg.targets, which keeps growing with -dd */
+static struct strset_t targetset;
+
+/* IgnorePkg from pacman.conf. this belongs with the alpm handle rather than
+ * with cfg, since a daemon keeps the handle across requests */
+static struct strset_t pmignore;
+
+/* the terminal being printed to, as far as getcols is concerned */
+static int termcols = -1;
+
+/* sync db packages by name and by everything they provide, plus the answer
+ * to every lookup made so far */
+static struct {
+	int ready;
+	struct strset_t index;
+	struct strset_t memo;
+} providers;
+
+/* names of every package in the sync dbs, for spotting foreign packages */
+static struct {
+	pthread_t thread;
+	int running;
+	int ready;
+	double elapsed;
+	struct strset_t names;
+} syncindex;
+
+/* --stats bookkeeping. phases are wall clock time. the sync index thread
+ * times itself and is only read back here once joined. extractions overlap,
+ * so the main thread counts the time any of them was running */
+static struct {
+	double start;
+	double phase[PHASE_MAX];
+	double busy;
+	double queuewait;
+	double bytes;
+	int peak;
+	int extracting;
+	double extractsince;
+	int handshakes;
+	int reused;
+	long sharelocks;
+	alpm_list_t *requests;
+} stats;
+
+/* search terms, compiled once and checked against packages as they're parsed */
+static struct {
+	regex_t *regex;
+	int count;
+	int nomatch;
+	struct strset_t kept;
+} searchfilter;
+
+/* what the last update check found for each package, keyed by name */
+static struct {
+	struct strset_t pkgs;
+	int dirty;
+} snapshot;
+
+/* --daemon keeps alpm and curl warm between requests. requests are served one
+ * at a time, with the client's stdio standing in for ours while they run. */
+static struct {
+	int serving;
+	int skiprepos;
+	alpm_list_t *repos;
+	loglevel_t logmask;
+	struct timespec localmtime;
+	struct timespec syncmtime;
+	volatile sig_atomic_t quit;
+} server;
+
+/* --stream prints packages as soon as they're parsed. when nothing else needs
+ * them afterwards, they're freed as soon as they've been printed */
+static struct {
+	void (*printfn)(struct aurpkg_t*);
+	int drain;
+	size_t drained;
+} streaming;
+
+/* targets from stdin, read into the work queue whenever it runs dry rather
+ * than all up front */
+static struct {
+	int active;
+	int eof;
+	struct response_t carry;
+} feed;
+
+/* PKGBUILDs named with -p, parsed off the main thread. each file's depends
+ * are handed to the transfer loop as soon as that file is done */
+static struct {
+	pthread_t threads[PKGBUILD_THREADS];
+	int nthreads;
+	pthread_mutex_t lock;
+	alpm_list_t *files;
+	alpm_list_t *next;
+	alpm_list_t *ready;
+	int remaining;
+	int active;
+	int donefd[2];
+	double started;
+	double finished;
+} pkgbuilds = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.donefd = { -1, -1 }
+};
+
+/* everything printed for a package goes here first, and is written out in
+ * as few calls as possible */
+static struct response_t outbuf;
+
+/* --json and -0 */
+static yajl_gen jsongen;
+
+/* --format, compiled once into literal runs and conversions */
+static struct {
+	struct fmtop_t *ops;
+	int count;
+	char *text;
+} fmtprog;
+
+static struct {
+	CURLM *multi;
+	CURLSH *share;
+	struct transfer_t *pending;
+	struct transfer_t *pending_tail;
+	int npending;
+	int inflight;
+	int wakefd[2];
+
+	/* the connection window grows while latency holds near the best seen and
+	 * halves when the AUR starts pushing back. cfg.maxthreads is its ceiling */
+	double window;
+	double minlatency;
+	double srtt;
+	double lastcut;
+
+	/* transfers waiting out a backoff, soonest first */
+	struct transfer_t *retry;
+} transfers;
+
+/* response buffers are handed back here when a transfer finishes, so the next
+ * one can reuse the allocation instead of growing its own from scratch */
+static struct {
+	struct response_t bufs[BUFPOOL_MAX];
+	int count;
+} bufpool;
 
 static yajl_callbacks callbacks = {
 	NULL,             /* null */
@@ -366,6 +835,7 @@ static yajl_callbacks callbacks = {
 
 static char const *digits = "0123456789";
 static char const *printf_flags = "'-+ #0I";
+static char const *format_fields = "acdilmnopstuvCDMOPR";
 
 static const char *aur_cat[] = { NULL, "None", "daemons", "devel", "editors",
                                 "emulators", "games", "gnome", "i18n", "kde", "lib",
@@ -422,7 +892,7 @@ alpm_handle_t *alpm_init(void) /* {{{ */
 			if(STREQ(key, "IgnorePkg")) {
 				for(token = strtok(ptr, "\t\n "); token; token = strtok(NULL, "\t\n ")) {
 					cwr_printf(LOG_DEBUG, "ignoring package: %s\n", token);
-					cfg.ignore.pkgs = alpm_list_add(cfg.ignore.pkgs, strdup(token));
+					strset_add(&pmignore, token);
 				}
 			}
 		}
@@ -441,6 +911,8 @@ alpm_list_t *alpm_find_foreign_pkgs(void) /* {{{ */
 	const alpm_list_t *i;
 	alpm_list_t *ret = NULL;
 
+	syncindex_wait();
+
 	for(i = alpm_db_get_pkgcache(db_local); i; i = alpm_list_next(i)) {
 		alpm_pkg_t *pkg = i->data;
 
@@ -454,40 +926,98 @@ alpm_list_t *alpm_find_foreign_pkgs(void) /* {{{ */
 
 int alpm_pkg_is_foreign(alpm_pkg_t *pkg) /* {{{ */
 {
-	const alpm_list_t *i;
-	const char *pkgname;
+	return !strset_contains(&syncindex.names, alpm_pkg_get_name(pkg));
+} /* }}} */
+
+void alpm_provides_free(void) /* {{{ */
+{
+	size_t i;
+
+	for(i = 0; i < providers.index.size; i++) {
+		alpm_list_free(providers.index.vals[i]);
+	}
+	strset_free(&providers.index);
+	strset_free(&providers.memo);
+	providers.ready = 0;
+} /* }}} */
 
-	pkgname = alpm_pkg_get_name(pkg);
+void alpm_provides_init(void) /* {{{ */
+{
+	const alpm_list_t *i, *j, *k;
+	double t0 = stats_now();
 
 	for(i = alpm_option_get_syncdbs(pmhandle); i; i = alpm_list_next(i)) {
-		if(alpm_db_get_pkg(i->data, pkgname)) {
-			return 0;
+		for(j = alpm_db_get_pkgcache(i->data); j; j = alpm_list_next(j)) {
+			alpm_pkg_t *pkg = j->data;
+			const char *name = alpm_pkg_get_name(pkg);
+
+			strset_put(&providers.index, name,
+					alpm_list_add(strset_get(&providers.index, name), pkg));
+
+			for(k = alpm_pkg_get_provides(pkg); k; k = alpm_list_next(k)) {
+				const alpm_depend_t *provide = k->data;
+
+				strset_put(&providers.index, provide->name,
+						alpm_list_add(strset_get(&providers.index, provide->name), pkg));
+			}
 		}
 	}
 
-	return 1;
+	providers.ready = 1;
+	stats_add(PHASE_PKGCACHE, t0);
 } /* }}} */
 
 const char *alpm_provides_pkg(const char *pkgname) /* {{{ */
 {
+	static const char *none = "";
 	const alpm_list_t *i;
-	const char *dbname = NULL;
-	static pthread_mutex_t alpmlock = PTHREAD_MUTEX_INITIALIZER;
+	const char *dbname;
+	char *name;
 
-	pthread_mutex_lock(&alpmlock);
-	for(i = alpm_option_get_syncdbs(pmhandle); i; i = alpm_list_next(i)) {
-		alpm_db_t *db = i->data;
-		if(alpm_find_satisfier(alpm_db_get_pkgcache(db), pkgname)) {
+	dbname = strset_get(&providers.memo, pkgname);
+	if(dbname) {
+		return *dbname ? dbname : NULL;
+	}
+
+	if(!providers.ready) {
+		alpm_provides_init();
+	}
+
+	name = strndup(pkgname, strcspn(pkgname, "<>="));
+	if(!name) {
+		ALLOC_FAIL(strlen(pkgname) + 1);
+		return NULL;
+	}
+
+	/* candidates are in syncdb order. check them one db at a time so a
+	 * package name still beats a provision from the same db, like searching
+	 * each pkgcache would */
+	dbname = none;
+	for(i = strset_get(&providers.index, name); i;) {
+		alpm_db_t *db = alpm_pkg_get_db(i->data);
+		alpm_list_t *candidates = NULL;
+		alpm_pkg_t *pkg;
+
+		for(; i && alpm_pkg_get_db(i->data) == db; i = alpm_list_next(i)) {
+			candidates = alpm_list_add(candidates, i->data);
+		}
+
+		pkg = alpm_find_satisfier(candidates, pkgname);
+		alpm_list_free(candidates);
+		if(pkg) {
 			dbname = alpm_db_get_name(db);
 			break;
 		}
 	}
-	pthread_mutex_unlock(&alpmlock);
+	free(name);
+
+	strset_put(&providers.memo, pkgname, (void*)dbname);
 
-	return dbname;
+	return *dbname ? dbname : NULL;
 } /* }}} */
 
-int archive_extract_file(const struct response_t *file, char **subdir) /* {{{ */
+int archive_extract_file(struct extract_t *ex, const char *path, /* {{{ */
+		char **subdir)
 {
 	struct archive *archive;
 	struct archive_entry *entry;
@@ -498,9 +1028,13 @@ int archive_extract_file(const struct response_t *file, char **subdir) /* {{{ */
 	archive_read_support_compression_all(archive);
 	archive_read_support_format_all(archive);
 
-	want_subdir = (subdir != NULL);
-
-	ret = archive_read_open_memory(archive, file->data, file->size);
+	/* a cached tarball is read straight off the disk, anything else comes in
+	 * off the wire */
+	if(path) {
+		ret = archive_read_open_filename(archive, path, BUFSIZE_MIN);
+	} else {
+		ret = archive_read_open(archive, ex, NULL, archive_read_chunk, NULL);
+	}
 	if(ret == ARCHIVE_OK) {
 		while(archive_read_next_header(archive, &entry) == ARCHIVE_OK) {
 			const char *entryname = archive_entry_pathname(entry);
@@ -514,6 +1048,11 @@ int archive_extract_file(const struct response_t *file, char **subdir) /* {{{ */
 				}
 			}
 
+			if(archive_extract_unchanged(entry)) {
+				cwr_printf(LOG_DEBUG, "skipping unchanged file: %s\n", entryname);
+				continue;
+			}
+
 			cwr_printf(LOG_DEBUG, "extracting file: %s\n", entryname);
 
 			ok = archive_read_extract(archive, entry, archive_flags);
@@ -538,1743 +1077,5587 @@ int archive_extract_file(const struct response_t *file, char **subdir) /* {{{ */
 	return ret;
 } /* }}} */
 
-int aurpkg_cmp(const void *p1, const void *p2) /* {{{ */
+void *archive_extract_thread(void *arg) /* {{{ */
 {
-	const struct aurpkg_t *pkg1 = p1;
-	const struct aurpkg_t *pkg2 = p2;
+	struct extract_t *ex = arg;
 
-	return strcmp(pkg1->name, pkg2->name);
+	ex->ret = archive_extract_file(ex, NULL, &ex->subdir);
+
+	/* whatever is left on the wire is of no use to us now. if the transfer is
+	 * parked waiting for us, kick it so that it can notice. */
+	pthread_mutex_lock(&ex->lock);
+	ex->finished = 1;
+	if(ex->paused) {
+		ex->paused = 0;
+		transfer_wakeup(ex->transfer);
+	}
+	pthread_mutex_unlock(&ex->lock);
+
+	return NULL;
 } /* }}} */
 
-struct aurpkg_t *aurpkg_dup(const struct aurpkg_t *pkg) /* {{{ */
+void archive_extract_free(struct extract_t *ex) /* {{{ */
 {
-	struct aurpkg_t *newpkg;
+	if(!ex) {
+		return;
+	}
 
-	MALLOC(newpkg, sizeof(struct aurpkg_t), return NULL);
-	memcpy(newpkg, pkg, sizeof(struct aurpkg_t));
+	if(ex->started) {
+		pthread_mutex_lock(&ex->lock);
+		ex->eof = 1;
+		pthread_cond_signal(&ex->cond);
+		pthread_mutex_unlock(&ex->lock);
+		pthread_join(ex->thread, NULL);
+		stats_extract(0);
+	}
 
-	return newpkg;
+	if(ex->partfp) {
+		fclose(ex->partfp);
+	}
+
+	pthread_mutex_destroy(&ex->lock);
+	pthread_cond_destroy(&ex->cond);
+	FREE(ex->chunk);
+	FREE(ex->subdir);
+	FREE(ex->tarball);
+	FREE(ex->partial);
+	FREE(ex);
 } /* }}} */
 
-void aurpkg_free(void *pkg) /* {{{ */
+int archive_extract_unchanged(struct archive_entry *entry) /* {{{ */
 {
-	aurpkg_free_inner(pkg);
-	FREE(pkg);
+	struct stat st;
+
+	/* files are extracted with their permissions and mtime intact, so a file
+	 * that still matches on all of them was left there by the last run */
+	if(archive_entry_filetype(entry) != AE_IFREG ||
+			lstat(archive_entry_pathname(entry), &st) != 0) {
+		return 0;
+	}
+
+	return S_ISREG(st.st_mode) &&
+		st.st_size == archive_entry_size(entry) &&
+		st.st_mtime == archive_entry_mtime(entry) &&
+		(st.st_mode & 07777) == (archive_entry_perm(entry) & 07777);
 } /* }}} */
 
-void aurpkg_free_inner(struct aurpkg_t *pkg) /* {{{ */
+ssize_t archive_read_chunk(struct archive UNUSED *archive, void *client, /* {{{ */
+		const void **buf)
 {
-	if(!pkg) {
-		return;
+	struct extract_t *ex = client;
+	ssize_t len = 0;
+
+	pthread_mutex_lock(&ex->lock);
+
+	/* libarchive is done with whatever we handed it last time */
+	if(ex->handed) {
+		ex->handed = 0;
+		ex->full = 0;
+		if(ex->paused) {
+			ex->paused = 0;
+			transfer_wakeup(ex->transfer);
+		}
+	}
+
+	while(!ex->full && !ex->eof) {
+		pthread_cond_wait(&ex->cond, &ex->lock);
+	}
+
+	if(ex->full) {
+		*buf = ex->chunk;
+		len = ex->chunksz;
+		ex->handed = 1;
 	}
 
-	/* free allocated string fields */
-	FREE(pkg->name);
-	FREE(pkg->maint);
-	FREE(pkg->ver);
-	FREE(pkg->urlpath);
-	FREE(pkg->desc);
-	FREE(pkg->url);
-	FREE(pkg->lic);
+	pthread_mutex_unlock(&ex->lock);
 
-	/* free extended list info */
-	FREELIST(pkg->depends);
-	FREELIST(pkg->makedepends);
-	FREELIST(pkg->optdepends);
-	FREELIST(pkg->provides);
-	FREELIST(pkg->conflicts);
-	FREELIST(pkg->replaces);
+	return len;
 } /* }}} */
 
-int cwr_asprintf(char **string, const char *format, ...) /* {{{ */
+void *arena_alloc(struct arena_t *arena, size_t size) /* {{{ */
 {
-	int ret = 0;
-	va_list args;
+	struct arena_block_t *block = arena->blocks;
+	void *ptr;
 
-	va_start(args, format);
-	ret = vasprintf(string, format, args);
-	va_end(args);
+	/* keep everything pointer aligned */
+	size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
 
-	if(ret == -1) {
-		cwr_fprintf(stderr, LOG_ERROR, "failed to allocate string\n");
+	if(!block || block->size - block->used < size) {
+		size_t blocksz = size > ARENA_BLOCKSIZE ? size : ARENA_BLOCKSIZE;
+
+		block = malloc(sizeof(struct arena_block_t) + blocksz);
+		if(!block) {
+			ALLOC_FAIL(sizeof(struct arena_block_t) + blocksz);
+			return NULL;
+		}
+		block->size = blocksz;
+		block->used = 0;
+
+		/* an oversized request gets a block of its own. don't let it bury the
+		 * space left in the current one */
+		if(blocksz > ARENA_BLOCKSIZE && arena->blocks) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
 	}
 
-	return ret;
+	ptr = block->data + block->used;
+	block->used += size;
+
+	return ptr;
 } /* }}} */
 
-int cwr_fprintf(FILE *stream, loglevel_t level, const char *format, ...) /* {{{ */
+void arena_free(struct arena_t *arena) /* {{{ */
 {
-	int ret;
-	va_list args;
-
-	va_start(args, format);
-	ret = cwr_vfprintf(stream, level, format, args);
-	va_end(args);
+	struct arena_block_t *block, *next;
 
-	return ret;
+	for(block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	arena->blocks = NULL;
 } /* }}} */
 
-int cwr_printf(loglevel_t level, const char *format, ...) /* {{{ */
+struct arena_t *arena_new(void) /* {{{ */
 {
-	int ret;
-	va_list args;
+	struct arena_t *arena;
 
-	va_start(args, format);
-	ret = cwr_vfprintf(stdout, level, format, args);
-	va_end(args);
+	CALLOC(arena, 1, sizeof(struct arena_t), return NULL);
+	arena->refcount = 1;
 
-	return ret;
+	return arena;
 } /* }}} */
 
-int cwr_vfprintf(FILE *stream, loglevel_t level, const char *format, va_list args) /* {{{ */
+struct arena_t *arena_ref(struct arena_t *arena) /* {{{ */
 {
-	const char *prefix;
-	char bufout[128];
-
-	if(!(cfg.logmask & level)) {
-		return 0;
+	if(arena) {
+		arena->refcount++;
 	}
 
-	switch(level) {
-		case LOG_VERBOSE:
-		case LOG_INFO:
-			prefix = colstr->info;
-			break;
-		case LOG_ERROR:
-			prefix = colstr->error;
-			break;
-		case LOG_WARN:
-			prefix = colstr->warn;
-			break;
-		case LOG_DEBUG:
-			prefix = "debug:";
-			break;
-		default:
-			prefix = "";
-			break;
+	return arena;
+} /* }}} */
+
+void arena_release(struct arena_t *arena) /* {{{ */
+{
+	if(!arena || --arena->refcount > 0) {
+		return;
 	}
 
-	/* f.l.w.: 128 should be big enough... */
-	snprintf(bufout, 128, "%s %s", prefix, format);
+	arena_free(arena);
+	free(arena);
+} /* }}} */
 
-	return vfprintf(stream, bufout, args);
+char *arena_strdup(struct arena_t *arena, const char *str) /* {{{ */
+{
+	return arena_strndup(arena, str, strlen(str));
 } /* }}} */
 
-CURL *curl_init_easy_handle(CURL *handle) /* {{{ */
+char *arena_strndup(struct arena_t *arena, const char *str, size_t len) /* {{{ */
 {
-	if(!handle) {
-		return NULL;
+	char *dup;
+
+	dup = arena_alloc(arena, len + 1);
+	if(dup) {
+		memcpy(dup, str, len);
+		dup[len] = '\0';
 	}
 
-	curl_easy_reset(handle);
-	curl_easy_setopt(handle, CURLOPT_USERAGENT, COWER_USERAGENT);
-	curl_easy_setopt(handle, CURLOPT_ENCODING, "deflate, gzip");
-	curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, cfg.timeout);
-	curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+	return dup;
+} /* }}} */
 
-	/* This is required of multi-threaded apps using timeouts. See
-	 * curl_easy_setopt(3) */
-	if(cfg.timeout > 0L) {
-		curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
-	}
+int aurpkg_cmp(const void *p1, const void *p2) /* {{{ */
+{
+	const struct aurpkg_t *pkg1 = p1;
+	const struct aurpkg_t *pkg2 = p2;
 
-	return handle;
+	return strcmp(pkg1->name, pkg2->name);
 } /* }}} */
 
-char *curl_get_url_as_buffer(CURL *curl, const char *url) /* {{{ */
+int aurpkg_ptrcmp(const void *p1, const void *p2) /* {{{ */
 {
-	long httpcode;
-	struct response_t response = { NULL, 0 };
-	CURLcode curlstat;
+	return aurpkg_cmp(*(struct aurpkg_t* const*)p1, *(struct aurpkg_t* const*)p2);
+} /* }}} */
 
-	curl = curl_init_easy_handle(curl);
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_response);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+struct aurpkg_t *aurpkg_dup(const struct aurpkg_t *pkg) /* {{{ */
+{
+	struct aurpkg_t *newpkg;
 
-	cwr_printf(LOG_DEBUG, "get_url_as_buffer: curl_easy_perform %s\n", url);
-	curlstat = curl_easy_perform(curl);
-	if(curlstat != CURLE_OK) {
-		cwr_fprintf(stderr, LOG_ERROR, "%s: %s\n", url, curl_easy_strerror(curlstat));
-		goto finish;
+	/* the copy lives next to its strings, and keeps all of them alive */
+	newpkg = arena_alloc(pkg->arena, sizeof(struct aurpkg_t));
+	if(!newpkg) {
+		return NULL;
 	}
+	memcpy(newpkg, pkg, sizeof(struct aurpkg_t));
+	arena_ref(newpkg->arena);
 
-	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpcode);
-	cwr_printf(LOG_DEBUG, "get_url_as_buffer: %s: server responded with %ld\n", url, httpcode);
-	if(httpcode >= 400) {
-		cwr_fprintf(stderr, LOG_ERROR, "%s: server responded with HTTP %ld\n",
-				url, httpcode);
+	return newpkg;
+} /* }}} */
+
+void aurpkg_free(void *pkg) /* {{{ */
+{
+	struct arena_t *arena;
+
+	if(!pkg) {
+		return;
 	}
 
-finish:
-	return response.data;
+	/* the package itself is in the arena, so grab it before letting go */
+	arena = ((struct aurpkg_t*)pkg)->arena;
+	aurpkg_free_inner(pkg);
+	arena_release(arena);
 } /* }}} */
 
-size_t curl_write_response(void *ptr, size_t size, size_t nmemb, void *stream) /* {{{ */
+void aurpkg_free_inner(struct aurpkg_t *pkg) /* {{{ */
 {
-	void *newdata;
-	size_t realsize = size * nmemb;
-	struct response_t *mem = stream;
-
-	newdata = realloc(mem->data, mem->size + realsize + 1);
-	if(newdata) {
-		mem->data = newdata;
-		memcpy(&(mem->data[mem->size]), ptr, realsize);
-		mem->size += realsize;
-		mem->data[mem->size] = '\0';
-	} else {
-		cwr_fprintf(stderr, LOG_ERROR, "failed to reallocate %zd bytes\n",
-				mem->size + realsize + 1);
-		return 0;
+	if(!pkg) {
+		return;
 	}
 
-	return realsize;
+	/* free extended list info. the strings, like the string fields, all live in
+	 * the arena shared with the rest of the response */
+	alpm_list_free(pkg->depends);
+	alpm_list_free(pkg->makedepends);
+	alpm_list_free(pkg->optdepends);
+	alpm_list_free(pkg->provides);
+	alpm_list_free(pkg->conflicts);
+	alpm_list_free(pkg->replaces);
+	pkg->depends = pkg->makedepends = pkg->optdepends = NULL;
+	pkg->provides = pkg->conflicts = pkg->replaces = NULL;
 } /* }}} */
 
-void *download(CURL *curl, void *arg) /* {{{ */
+void aurpkg_extinfo_cb(void *pkgbuild, void *arg) /* {{{ */
 {
-	alpm_list_t *queryresult = NULL;
-	struct aurpkg_t *result;
-	CURLcode curlstat;
-	char *url, *escaped, *subdir = NULL;
-	int ret;
-	long httpcode;
-	struct response_t response = { 0, 0 };
+	struct aurpkg_t *aurpkg = arg;
 
-	curl = curl_init_easy_handle(curl);
+	alpm_list_t **pkg_details[PKGDETAIL_MAX] = {
+		&aurpkg->depends, &aurpkg->makedepends, &aurpkg->optdepends,
+		&aurpkg->provides, &aurpkg->conflicts, &aurpkg->replaces
+	};
 
-	queryresult = task_query(curl, arg);
-	if(!queryresult) {
-		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
-		cwr_fprintf(stderr, LOG_ERROR, "no results found for %s\n", (const char*)arg);
-		return NULL;
-	}
+	pkgbuild_get_extinfo(pkgbuild, pkg_details, aurpkg->arena);
 
-	if(access(arg, F_OK) == 0 && !cfg.force) {
-		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
-		cwr_fprintf(stderr, LOG_ERROR, "`%s/%s' already exists. Use -f to overwrite.\n",
-				cfg.dlpath, (const char*)arg);
-		alpm_list_free_inner(queryresult, aurpkg_free);
-		alpm_list_free(queryresult);
-		return NULL;
+	if(streaming.printfn) {
+		stream_pkg(aurpkg);
 	}
+} /* }}} */
 
-	curl_easy_setopt(curl, CURLOPT_ENCODING, "identity"); /* disable compression */
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_response);
+void aurpkg_get_extinfo(struct aurpkg_t *aurpkg) /* {{{ */
+{
+	char *pburl, *escaped;
 
-	result = queryresult->data;
-	escaped = url_escape(result->urlpath, 0, "/");
-	cwr_asprintf(&url, AUR_BASE_URL, escaped);
-	curl_easy_setopt(curl, CURLOPT_URL, url);
+	escaped = url_escape(aurpkg->urlpath, 0, "/");
+	cwr_asprintf(&pburl, AUR_BASE_URL, cfg.aururl, escaped);
+	memcpy(strrchr(pburl, '/') + 1, "PKGBUILD\0", 9);
+
+	curl_get_url_as_buffer(pburl, aurpkg_extinfo_cb, aurpkg);
 	free(escaped);
+	free(pburl);
+} /* }}} */
 
-	cwr_printf(LOG_DEBUG, "[%s]: curl_easy_perform %s\n", (const char*)arg, url);
-	curlstat = curl_easy_perform(curl);
+void cache_free(struct cache_t *cache) /* {{{ */
+{
+	if(!cache) {
+		return;
+	}
 
-	if(curlstat != CURLE_OK) {
-		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
-		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", (const char*)arg, curl_easy_strerror(curlstat));
-		goto finish;
-	}
+	FREE(cache->path);
+	FREE(cache->buf);
+	FREE(cache->etag);
+	FREE(cache->lastmod);
+	FREE(cache);
+} /* }}} */
 
-	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpcode);
-	cwr_printf(LOG_DEBUG, "[%s]: server responded with %ld\n", (const char *)arg, httpcode);
+int cache_init(void) /* {{{ */
+{
+	char cache_path[PATH_MAX];
 
-	switch(httpcode) {
-		case 200:
-			break;
-		default:
-			cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
-			cwr_fprintf(stderr, LOG_ERROR, "[%s]: server responded with HTTP %ld\n",
-					(const char*)arg, httpcode);
-			goto finish;
+	if(cfg.cachettl < 0) {
+		return 0;
 	}
 
-	ret = archive_extract_file(&response, &subdir);
-	if(ret != 0) {
-		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
-		cwr_fprintf(stderr, LOG_ERROR, "[%s]: failed to extract tarball: %s\n",
-				(const char*)arg, strerror(ret));
-		goto finish;
+	if(get_cache_path(cache_path, sizeof(cache_path)) != 0) {
+		cwr_fprintf(stderr, LOG_WARN, "unable to determine cache directory\n");
+		return 1;
 	}
 
-	cwr_printf(LOG_BRIEF, BRIEF_OK "\t%s\t", result->name);
-	cwr_printf(LOG_INFO, "%s%s%s downloaded to %s\n",
-			colstr->pkg, result->name, colstr->nc, cfg.dlpath);
-
-	if(cfg.getdeps) {
-		resolve_dependencies(curl, arg, subdir);
+	if(mkdir_p(cache_path) != 0) {
+		cwr_fprintf(stderr, LOG_WARN, "failed to create cache directory %s: %s\n",
+				cache_path, strerror(errno));
+		return 1;
 	}
 
-finish:
-	FREE(url);
-	FREE(response.data);
-	FREE(subdir);
+	cwr_printf(LOG_DEBUG, "caching RPC responses in %s\n", cache_path);
+	cfg.cachedir = strdup(cache_path);
+
+	/* not having this only means downloading every tarball again */
+	strncat(cache_path, "/" TARBALL_DIR, sizeof(cache_path) - strlen(cache_path) - 1);
+	if(mkdir_p(cache_path) != 0) {
+		cwr_printf(LOG_DEBUG, "failed to create tarball cache %s: %s\n",
+				cache_path, strerror(errno));
+	}
 
-	return queryresult;
+	return 0;
 } /* }}} */
 
-alpm_list_t *filter_results(alpm_list_t *list) /* {{{ */
+struct cache_t *cache_load(const char *url) /* {{{ */
 {
-	const alpm_list_t *i, *j;
-	alpm_list_t *filterlist = NULL;
+	struct cache_t *cache;
+	struct stat st;
+	char *p, *fields[3];
+	int n;
+
+	MALLOC(cache, sizeof(struct cache_t), return NULL);
+	if(cwr_asprintf(&cache->path, "%s/%016llx", cfg.cachedir, strhash(url)) == -1) {
+		FREE(cache);
+		return NULL;
+	}
 
-	if(!(cfg.opmask & OP_SEARCH)) {
-		return list;
+	/* not being cached yet isn't an error */
+	if(stat(cache->path, &st) != 0 || !(cache->buf = get_file_as_buffer(cache->path))) {
+		return cache;
 	}
 
-	for(i = cfg.targets; i; i = alpm_list_next(i)) {
-		regex_t regex;
-		const char *targ = i->data;
-		filterlist = NULL;
-
-		if(regcomp(&regex, targ, REGEX_OPTS) == 0) {
-			for(j = list; j; j = alpm_list_next(j)) {
-				struct aurpkg_t *pkg = j->data;
-				const char *name = pkg->name;
-				const char *desc = pkg->desc;
-
-				if(regexec(&regex, name, 0, 0, 0) != REG_NOMATCH ||
-						regexec(&regex, desc, 0, 0, 0) != REG_NOMATCH) {
-					filterlist = alpm_list_add(filterlist, pkg);
-				} else {
-					aurpkg_free(pkg);
-				}
-			}
-			regfree(&regex);
+	/* the URL, ETag and Last-Modified header each get a line ahead of the
+	 * response body */
+	for(p = cache->buf, n = 0; n < 3; n++) {
+		char *eol = strchr(p, '\n');
+		if(!eol) {
+			FREE(cache->buf);
+			return cache;
 		}
-
-		/* switcheroo */
-		alpm_list_free(list);
-		list = filterlist;
+		*eol = '\0';
+		fields[n] = p;
+		p = eol + 1;
 	}
 
-	return alpm_list_msort(filterlist, alpm_list_count(filterlist), aurpkg_cmp);
-} /* }}} */
-
-int getcols(void) /* {{{ */
-{
-	int termwidth = -1;
-	const int default_tty = 80;
-	const int default_notty = 0;
-
-	if(!isatty(fileno(stdout))) {
-		return default_notty;
+	/* hash collision */
+	if(!STREQ(fields[0], url)) {
+		FREE(cache->buf);
+		return cache;
 	}
 
-#ifdef TIOCGSIZE
-	struct ttysize win;
-	if(ioctl(1, TIOCGSIZE, &win) == 0) {
-		termwidth = win.ts_cols;
-	}
-#elif defined(TIOCGWINSZ)
-	struct winsize win;
-	if(ioctl(1, TIOCGWINSZ, &win) == 0) {
-		termwidth = win.ws_col;
-	}
-#endif
-	return termwidth <= 0 ? default_tty : termwidth;
+	cache->etag = *fields[1] ? strdup(fields[1]) : NULL;
+	cache->lastmod = *fields[2] ? strdup(fields[2]) : NULL;
+	cache->data = p;
+	cache->size = strlen(p);
+	cache->mtime = st.st_mtime;
+
+	return cache;
 } /* }}} */
 
-char *get_file_as_buffer(const char *path) /* {{{ */
+void cache_save(const struct cache_t *cache, const char *url, /* {{{ */
+		const struct response_t *response)
 {
+	char *tmpfile;
 	FILE *fp;
-	char *buf;
-	long fsize, nread;
-
-	fp = fopen(path, "r");
-	if(!fp) {
-		cwr_fprintf(stderr, LOG_ERROR, "error: failed to open %s: %s\n",
-				path, strerror(errno));
-		return NULL;
-	}
-
-	fseek(fp, 0L, SEEK_END);
-	fsize = ftell(fp);
-	fseek(fp, 0L, SEEK_SET);
-
-	CALLOC(buf, 1, (ssize_t)fsize + 1, return NULL);
-
-	nread = fread(buf, 1, fsize, fp);
-	fclose(fp);
+	int fd;
 
-	if(nread < fsize) {
-		cwr_fprintf(stderr, LOG_ERROR, "Failed to read full PKGBUILD\n");
-		return NULL;
+	if(cwr_asprintf(&tmpfile, "%s.XXXXXX", cache->path) == -1) {
+		return;
 	}
 
-	return buf;
-} /* }}} */
-
-int get_config_path(char *config_path, size_t pathlen) /* {{{ */
-{
-	char *var;
-	struct passwd *pwd;
-
-	var = getenv("XDG_CONFIG_HOME");
-	if(var != NULL) {
-		snprintf(config_path, pathlen, "%s/cower/config", var);
-		return 0;
+	fd = mkstemp(tmpfile);
+	if(fd < 0 || !(fp = fdopen(fd, "w"))) {
+		cwr_printf(LOG_DEBUG, "failed to open cache file %s: %s\n", tmpfile, strerror(errno));
+		if(fd >= 0) {
+			close(fd);
+			unlink(tmpfile);
+		}
+		free(tmpfile);
+		return;
 	}
 
-	var = getenv("HOME");
-	if(var != NULL) {
-		snprintf(config_path, pathlen, "%s/.config/cower/config", var);
-		return 0;
+	fprintf(fp, "%s\n%s\n%s\n", url, cache->etag ? cache->etag : "",
+			cache->lastmod ? cache->lastmod : "");
+	if(response->size) {
+		fwrite(response->data, 1, response->size, fp);
 	}
 
-	pwd = getpwuid(getuid());
-	if(pwd != NULL && pwd->pw_dir != NULL) {
-		snprintf(config_path, pathlen, "%s/.config/cower/config", pwd->pw_dir);
-		return 0;
+	/* rename over the old entry so that readers never see a partial file */
+	if(fclose(fp) != 0 || rename(tmpfile, cache->path) != 0) {
+		cwr_printf(LOG_DEBUG, "failed to write cache file %s: %s\n", cache->path, strerror(errno));
+		unlink(tmpfile);
 	}
 
-	return 1;
+	free(tmpfile);
 } /* }}} */
 
-void indentprint(const char *str, int indent) /* {{{ */
+char *cache_tarball_path(const struct aurpkg_t *pkg) /* {{{ */
 {
-	wchar_t *wcstr;
-	const wchar_t *p;
-	int len, cidx, cols;
+	char *path;
 
-	if(!str) {
-		return;
+	/* the AUR bumps LastModified whenever a new tarball is uploaded, so the
+	 * two together name a tarball's contents */
+	if(cwr_asprintf(&path, "%s/" TARBALL_DIR "/%016llx-%lld.tar.gz", cfg.cachedir,
+				strhash(pkg->urlpath), (long long)pkg->lastmod) == -1) {
+		return NULL;
 	}
 
-	cols = getcols();
-
-	/* if we're not a tty, print without indenting */
-	if(cols == 0) {
-		fputs(str, stdout);
-		return;
-	}
+	return path;
+} /* }}} */
 
-	len = strlen(str) + 1;
-	CALLOC(wcstr, len, sizeof(wchar_t), return);
-	len = mbstowcs(wcstr, str, len);
-	p = wcstr;
-	cidx = indent;
+void cache_tarball_prune(const struct aurpkg_t *pkg, const char *keep) /* {{{ */
+{
+	char *pattern;
+	glob_t matches;
+	size_t i;
 
-	if(!p || !len) {
+	/* older uploads of the same package, and whatever is left of them */
+	if(cwr_asprintf(&pattern, "%s/" TARBALL_DIR "/%016llx-*", cfg.cachedir,
+				strhash(pkg->urlpath)) == -1) {
 		return;
 	}
 
-	while(*p) {
-		if(*p == L' ') {
-			const wchar_t *q, *next;
-			p++;
-			if(!p || *p == L' ') {
-				continue;
-			}
-			next = wcschr(p, L' ');
-			if(!next) {
-				next = p + wcslen(p);
-			}
-
-			/* len captures # cols */
-			len = 0;
-			q = p;
-
-			while(q < next) {
-				len += wcwidth(*q++);
-			}
-
-			if(len > (cols - cidx - 1)) {
-				/* wrap to a newline and reindent */
-				printf("\n%-*s", indent, "");
-				cidx = indent;
-			} else {
-				fputc(' ', stdout);
-				cidx++;
+	if(glob(pattern, GLOB_NOSORT, NULL, &matches) == 0) {
+		for(i = 0; i < matches.gl_pathc; i++) {
+			if(!STREQ(matches.gl_pathv[i], keep)) {
+				cwr_printf(LOG_DEBUG, "removing stale tarball %s\n", matches.gl_pathv[i]);
+				unlink(matches.gl_pathv[i]);
 			}
-			continue;
 		}
-#ifdef __clang__
-		printf("%lc", *p);
-#else /* assume GCC */
-		printf("%lc", (wint_t)*p);
-#endif
-		cidx += wcwidth(*p);
-		p++;
+		globfree(&matches);
 	}
-	free(wcstr);
+
+	free(pattern);
 } /* }}} */
 
-int json_end_map(void *ctx) /* {{{ */
+double clock_now(void) /* {{{ */
 {
-	struct yajl_parser_t *p = ctx;
+	struct timespec ts;
 
-	p->json_depth--;
-	if(p->json_depth > 0) {
-		if(!(p->aurpkg->ood && cfg.ignoreood)) {
-			p->pkglist = alpm_list_add_sorted(p->pkglist, aurpkg_dup(p->aurpkg), aurpkg_cmp);
-		} else {
-			aurpkg_free_inner(p->aurpkg);
-		}
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+		return 0;
 	}
 
-	return 1;
+	return ts.tv_sec + ts.tv_nsec / 1e9;
 } /* }}} */
 
-int json_integer(void *ctx, long long val) /* {{{ */
+void config_init(void) /* {{{ */
 {
-	struct yajl_parser_t *p = ctx;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.color = cfg.maxthreads = cfg.timeout = cfg.cachettl = UNSET;
+	cfg.delim = LIST_DELIM;
+	cfg.jsondelim = '\n';
+	cfg.logmask = LOG_ERROR|LOG_WARN|LOG_INFO;
+	cfg.ignoreood = UNSET;
+} /* }}} */
+
+int cwr_asprintf(char **string, const char *format, ...) /* {{{ */
+{
+	int ret = 0;
+	va_list args;
 
-	if(KEY_IS(AUR_ID)) {
-		p->aurpkg->id = (int)val;
-	} else if(KEY_IS(AUR_CAT)) {
-		p->aurpkg->cat = (int)val;
-	} else if(KEY_IS(AUR_VOTES)) {
-		p->aurpkg->votes = (int)val;
-	} else if(KEY_IS(AUR_OOD)) {
-		p->aurpkg->ood = (int)val;
-	} else if(KEY_IS(AUR_FIRSTSUB)) {
-		p->aurpkg->firstsub = (time_t)val;
-	} else if(KEY_IS(AUR_LASTMOD)) {
-		p->aurpkg->lastmod = (time_t)val;
-	} else if(KEY_IS(AUR_QUERY_RESULTCOUNT)) {
-		p->resultcount = (int)val;
+	va_start(args, format);
+	ret = vasprintf(string, format, args);
+	va_end(args);
+
+	if(ret == -1) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to allocate string\n");
 	}
 
-	return 1;
+	return ret;
 } /* }}} */
 
-int json_map_key(void *ctx, const unsigned char *data, size_t size) /* {{{ */
+int cwr_fprintf(FILE *stream, loglevel_t level, const char *format, ...) /* {{{ */
 {
-	struct yajl_parser_t *p = ctx;
+	int ret;
+	va_list args;
 
-	p->keysz = size;
-	memcpy(p->key, (const char*)data, size);
-	p->key[size] = '\0';
+	va_start(args, format);
+	ret = cwr_vfprintf(stream, level, format, args);
+	va_end(args);
 
-	return 1;
+	return ret;
 } /* }}} */
 
-int json_start_map(void *ctx) /* {{{ */
+int cwr_printf(loglevel_t level, const char *format, ...) /* {{{ */
 {
-	struct yajl_parser_t *p = ctx;
+	int ret;
+	va_list args;
 
-	p->json_depth++;
-	if(p->json_depth > 1) {
-		memset(p->aurpkg, 0, sizeof(struct aurpkg_t));
-	}
+	va_start(args, format);
+	ret = cwr_vfprintf(stdout, level, format, args);
+	va_end(args);
 
-	return 1;
+	return ret;
 } /* }}} */
 
-int json_string(void *ctx, const unsigned char *data, size_t size) /* {{{ */
+int cwr_vfprintf(FILE *stream, loglevel_t level, const char *format, va_list args) /* {{{ */
 {
-	struct yajl_parser_t *p = ctx;
-	char **key = NULL;
+	const char *prefix;
+	char bufout[128];
 
-	if(KEY_IS(AUR_QUERY_TYPE) &&
-			STR_STARTS_WITH((const char*)data, AUR_QUERY_ERROR)) {
-		return 1;
+	if(!(cfg.logmask & level)) {
+		return 0;
 	}
 
-	if(KEY_IS(NAME)) {
-		key = &p->aurpkg->name;
-	} else if(KEY_IS(PKG_MAINT)) {
-		key = &p->aurpkg->maint;
-	} else if(KEY_IS(VERSION)) {
-		key = &p->aurpkg->ver;
-	} else if(KEY_IS(AUR_DESC)) {
-		key = &p->aurpkg->desc;
-	} else if(KEY_IS(URL)) {
-		key = &p->aurpkg->url;
-	} else if(KEY_IS(URLPATH)) {
-		key = &p->aurpkg->urlpath;
-	} else if(KEY_IS(AUR_LICENSE)) {
-		key = &p->aurpkg->lic;
-	} else {
-		return 1;
+	switch(level) {
+		case LOG_VERBOSE:
+		case LOG_INFO:
+			prefix = colstr->info;
+			break;
+		case LOG_ERROR:
+			prefix = colstr->error;
+			break;
+		case LOG_WARN:
+			prefix = colstr->warn;
+			break;
+		case LOG_DEBUG:
+			prefix = "debug:";
+			break;
+		default:
+			prefix = "";
+			break;
 	}
 
-	*key = strndup((const char*)data, size);
-	if(*key == NULL) {
-		cwr_fprintf(stderr, LOG_ERROR, "failed to allocate string: %s\n",
-				strerror(errno));
-	}
+	/* f.l.w.: 128 should be big enough... */
+	snprintf(bufout, 128, "%s %s", prefix, format);
 
-	return 1;
+	return vfprintf(stream, bufout, args);
 } /* }}} */
 
-alpm_list_t *load_targets_from_files(alpm_list_t *files) /* {{{ */
+CURL *curl_init_easy_handle(CURL *handle) /* {{{ */
 {
-	alpm_list_t *i, *targets = NULL, *results = NULL;
-
-	for(i = files; i; i = i->next) {
-		alpm_list_t *depends = NULL;
-		char *pkgbuild = get_file_as_buffer(i->data);
-
-		alpm_list_t **pkg_details[PKGDETAIL_MAX] = {
-			&depends, &depends, NULL, NULL, NULL
-		};
-
-		pkgbuild_get_extinfo(pkgbuild, pkg_details);
-		free(pkgbuild);
-
-		results = alpm_list_join(results, depends);
+	if(!handle) {
+		return NULL;
 	}
 
-	/* sanitize and dedupe */
-	for(i = results; i; i = i->next) {
-		char *sanitized = strdup(i->data);
+	curl_easy_reset(handle);
+	curl_easy_setopt(handle, CURLOPT_USERAGENT, COWER_USERAGENT);
+	curl_easy_setopt(handle, CURLOPT_ENCODING, "deflate, gzip");
+	curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, cfg.timeout);
+	curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
 
-		sanitized[strcspn(sanitized, "<>=")] = '\0';
-		if(!alpm_list_find_str(targets, sanitized)) {
-			targets = alpm_list_add(targets, sanitized);
-		}
+	/* DNS and TLS sessions are shared between every handle, so only the first
+	 * connection to the AUR pays for a full handshake */
+	if(transfers.share) {
+		curl_easy_setopt(handle, CURLOPT_SHARE, transfers.share);
 	}
 
-	return targets;
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+#ifdef CURLPIPE_MULTIPLEX
+	/* prefer waiting on an existing connection that can multiplex over
+	 * opening a new one */
+	curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+	return handle;
 } /* }}} */
 
-void openssl_crypto_cleanup(void) /* {{{ */
+void curl_buffer_done(struct transfer_t *t, CURLcode curlstat) /* {{{ */
 {
-	int i;
+	long httpcode;
 
-	CRYPTO_set_locking_callback(NULL);
+	if(curlstat != CURLE_OK) {
+		cwr_fprintf(stderr, LOG_ERROR, "%s: %s\n", t->url, curl_easy_strerror(curlstat));
+		t->cb(NULL, t->data);
+		return;
+	}
 
-	for(i = 0; i < CRYPTO_num_locks(); i++) {
-		pthread_mutex_destroy(&(openssl_lock.lock[i]));
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	cwr_printf(LOG_DEBUG, "get_url_as_buffer: %s: server responded with %ld\n", t->url, httpcode);
+	if(httpcode >= 400) {
+		cwr_fprintf(stderr, LOG_ERROR, "%s: server responded with HTTP %ld\n",
+				t->url, httpcode);
 	}
 
-	OPENSSL_free(openssl_lock.lock);
-	OPENSSL_free(openssl_lock.lock_count);
+	/* the buffer still belongs to the transfer, and is recycled once the
+	 * callback returns */
+	t->cb(t->response.data, t->data);
 } /* }}} */
 
-void openssl_crypto_init(void) /* {{{ */
+void curl_get_url_as_buffer(const char *url, void (*cb)(void*, void*), void *data) /* {{{ */
 {
-	int i;
+	struct transfer_t *t;
 
-	openssl_lock.lock = OPENSSL_malloc(CRYPTO_num_locks() * sizeof(pthread_mutex_t));
-	openssl_lock.lock_count = OPENSSL_malloc(CRYPTO_num_locks() * sizeof(long));
-	for(i = 0; i < CRYPTO_num_locks(); i++) {
-		openssl_lock.lock_count[i] = 0;
-		pthread_mutex_init(&(openssl_lock.lock[i]), NULL);
+	t = transfer_new(url, url, curl_buffer_done);
+	if(!t) {
+		cb(NULL, data);
+		return;
 	}
 
-	CRYPTO_set_id_callback(openssl_thread_id);
-	CRYPTO_set_locking_callback(openssl_thread_cb);
-} /* }}} */
-
-void openssl_thread_cb(int mode, int type, const char UNUSED *file, /* {{{ */
-		int UNUSED line)
-{
-	if(mode & CRYPTO_LOCK) {
-		pthread_mutex_lock(&(openssl_lock.lock[type]));
-		openssl_lock.lock_count[type]++;
-	} else {
-		pthread_mutex_unlock(&(openssl_lock.lock[type]));
-		openssl_lock.lock_count[type]--;
-	}
-} /* }}} */
+	t->cb = cb;
+	t->data = data;
+	curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, curl_write_response);
+	curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t);
 
-unsigned long openssl_thread_id(void) /* {{{ */
-{
-	return pthread_self();
+	transfer_start(t);
 } /* }}} */
 
-alpm_list_t *parse_bash_array(alpm_list_t *deplist, char *array, pkgdetail_t type) /* {{{ */
+void curl_get_url_as_pkglist(const char *url, const char *label, /* {{{ */
+		void (*cb)(void*, void*), void *data)
 {
-	char *ptr, *token, *saveptr;
+	struct transfer_t *t;
 
-	if(!array) {
-		return NULL;
+	t = transfer_new(url, label, curl_pkglist_done);
+	if(!t) {
+		cb(NULL, data);
+		return;
 	}
 
-	if(type == PKGDETAIL_OPTDEPENDS) {
-		const char *arrayend = rawmemchr(array, '\0');
-		for(token = array; token <= arrayend; token++) {
-			if(*token == '\'' || *token == '\"') {
-				token++;
-				ptr = memchr(token, *(token - 1), arrayend - token);
-				*ptr = '\0';
-			} else if(isalpha(*token)) {
-				ptr = token;
-				while(!isspace(*++ptr));
-				*(ptr - 1) = '\0';
-			} else {
-				continue;
-			}
-
-			strtrim(token);
-			cwr_printf(LOG_DEBUG, "adding depend: %s\n", token);
-			deplist = alpm_list_add(deplist, strdup(token));
+	t->cb = cb;
+	t->data = data;
+	CALLOC(t->parse_struct, 1, sizeof(struct yajl_parser_t), goto error);
+	CALLOC(t->parse_struct->aurpkg, 1, sizeof(struct aurpkg_t), goto error);
+	t->parse_struct->arena = arena_new();
+	if(!t->parse_struct->arena) {
+		goto error;
+	}
+	t->yajl_hand = yajl_alloc(&callbacks, NULL, (void*)t->parse_struct);
+	if(!t->yajl_hand) {
+		goto error;
+	}
 
-			token = ptr;
-		}
-		return deplist;
+	if(cfg.cachedir) {
+		t->cache = cache_load(url);
 	}
 
-	for(token = strtok_r(array, " \t\n", &saveptr); token;
-			token = strtok_r(NULL, " \t\n", &saveptr)) {
-		/* found an embedded comment. skip to the next line */
-		if(*token == '#') {
-			strtok_r(NULL, "\n", &saveptr);
-			continue;
+	if(t->cache && t->cache->data) {
+		if(time(NULL) - t->cache->mtime < cfg.cachettl) {
+			double t0 = stats_now();
+
+			cwr_printf(LOG_DEBUG, "[%s]: using cached response for %s\n", label, url);
+			yajl_parse(t->yajl_hand, (const unsigned char*)t->cache->data, t->cache->size);
+			yajl_complete_parse(t->yajl_hand);
+			stats_add(PHASE_JSON, t0);
+			cb(t->parse_struct->pkglist, data);
+			t->parse_struct->pkglist = NULL;
+			transfer_free(t);
+			return;
 		}
 
-		/* unquote the element */
-		if(*token == '\'' || *token == '\"') {
-			ptr = strrchr(token + 1, *token);
-			if(ptr) {
-				token++;
-				*ptr = '\0';
+		/* stale, but the server might still tell us it hasn't changed */
+		if(t->cache->etag) {
+			char *header;
+			if(cwr_asprintf(&header, "If-None-Match: %s", t->cache->etag) != -1) {
+				t->headers = curl_slist_append(t->headers, header);
+				free(header);
 			}
 		}
-
-		/* some people feel compelled to do insane things in PKGBUILDs. these people suck */
-		if(!*token || strlen(token) < 2 || *token == '$') {
-			continue;
+		if(t->cache->lastmod) {
+			char *header;
+			if(cwr_asprintf(&header, "If-Modified-Since: %s", t->cache->lastmod) != -1) {
+				t->headers = curl_slist_append(t->headers, header);
+				free(header);
+			}
 		}
+		curl_easy_setopt(t->curl, CURLOPT_HTTPHEADER, t->headers);
+	}
 
-		cwr_printf(LOG_DEBUG, "adding depend: %s\n", token);
-		if(!alpm_list_find_str(deplist, token)) {
-			deplist = alpm_list_add(deplist, strdup(token));
+	if(t->cache) {
+		curl_easy_setopt(t->curl, CURLOPT_HEADERFUNCTION, curl_write_header);
+		curl_easy_setopt(t->curl, CURLOPT_HEADERDATA, t);
+	}
+
+	curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, yajl_parse_stream);
+	curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t);
+
+	transfer_start(t);
+	return;
+
+error:
+	transfer_free(t);
+	cb(NULL, data);
+} /* }}} */
+
+void curl_pkglist_done(struct transfer_t *t, CURLcode curlstat) /* {{{ */
+{
+	long httpcode;
+	double t0;
+
+	if(curlstat != CURLE_OK) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", t->label,
+				curl_easy_strerror(curlstat));
+		t->cb(NULL, t->data);
+		return;
+	}
+
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	cwr_printf(LOG_DEBUG, "[%s]: server responded with %ld\n", t->label, httpcode);
+	if(httpcode >= 400) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: server responded with HTTP %ld\n",
+				t->label, httpcode);
+		t->cb(NULL, t->data);
+		return;
+	}
+
+	t0 = stats_now();
+	if(t->cache && httpcode == 304 && t->cache->data) {
+		cwr_printf(LOG_DEBUG, "[%s]: not modified, using cached response\n", t->label);
+		yajl_parse(t->yajl_hand, (const unsigned char*)t->cache->data, t->cache->size);
+		utime(t->cache->path, NULL);
+	}
+
+	yajl_complete_parse(t->yajl_hand);
+	stats_add(PHASE_JSON, t0);
+
+	/* only once the parser has seen what kind of response this was */
+	if(t->cache && httpcode == 200) {
+		if(t->parse_struct->rpcerror) {
+			cwr_printf(LOG_DEBUG, "[%s]: rpc error, not caching response\n", t->label);
+		} else {
+			cache_save(t->cache, t->url, &t->response);
 		}
 	}
 
-	return deplist;
+	t->cb(t->parse_struct->pkglist, t->data);
+	t->parse_struct->pkglist = NULL;
 } /* }}} */
 
-int parse_configfile(void) /* {{{ */
+size_t curl_write_header(char *ptr, size_t size, size_t nmemb, void *userdata) /* {{{ */
 {
-	char line[BUFSIZ], config_path[PATH_MAX];
-	int ret = 0;
-	FILE *fp;
+	struct transfer_t *t = userdata;
+	size_t realsize = size * nmemb, len;
+	char **field;
+	const char *val;
+
+#define HEADER_IS(h) (realsize > strlen(h) && strncasecmp(ptr, (h), strlen(h)) == 0)
+	if(HEADER_IS("HTTP/")) {
+		/* a new response, e.g. after a redirect. forget the old validators */
+		FREE(t->cache->etag);
+		FREE(t->cache->lastmod);
+		return realsize;
+	} else if(HEADER_IS("ETag:")) {
+		field = &t->cache->etag;
+		val = ptr + strlen("ETag:");
+	} else if(HEADER_IS("Last-Modified:")) {
+		field = &t->cache->lastmod;
+		val = ptr + strlen("Last-Modified:");
+	} else {
+		return realsize;
+	}
+#undef HEADER_IS
 
-	if(get_config_path(config_path, sizeof(config_path)) != 0) {
-		return 0;
+	len = realsize - (val - ptr);
+	while(len && isspace((unsigned char)*val)) {
+		val++;
+		len--;
+	}
+	while(len && isspace((unsigned char)val[len - 1])) {
+		len--;
 	}
 
-	fp = fopen(config_path, "r");
-	if(!fp) {
-		cwr_printf(LOG_DEBUG, "config file not found. skipping parsing\n");
-		return 0; /* not an error, just nothing to do here */
+	free(*field);
+	*field = strndup(val, len);
+
+	return realsize;
+} /* }}} */
+
+int curl_write_partial(struct transfer_t *t, const void *ptr, size_t len) /* {{{ */
+{
+	struct extract_t *ex = t->extract;
+
+	if(!ex->partfp) {
+		return ex->resumed ? -1 : 0;
 	}
 
-	while(fgets(line, PATH_MAX, fp)) {
-		char *key, *val;
-		size_t linelen;
+	/* a download that can't be kept whole is better not kept at all */
+	if(fwrite(ptr, 1, len, ex->partfp) != len) {
+		cwr_printf(LOG_DEBUG, "[%s]: failed to write %s: %s\n", t->label,
+				ex->partial, strerror(errno));
+		fclose(ex->partfp);
+		ex->partfp = NULL;
+		unlink(ex->partial);
+		return -1;
+	}
 
-		linelen = strtrim(line);
-		if(!linelen || line[0] == '#') {
-			continue;
+	return 0;
+} /* }}} */
+
+size_t curl_write_archive(void *ptr, size_t size, size_t nmemb, void *stream) /* {{{ */
+{
+	struct transfer_t *t = stream;
+	struct extract_t *ex = t->extract;
+	size_t realsize = size * nmemb;
+	long httpcode;
+	int ret;
+
+	/* don't bother feeding an error page to libarchive. download_done will
+	 * report on the response code. */
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	if(httpcode != 200 && !(httpcode == 206 && ex->resumed)) {
+		return realsize;
+	}
+
+	/* the server ignored our range and is sending the whole thing */
+	if(ex->partfp && httpcode == 200 && ex->resumed) {
+		ex->resumed = 0;
+		if(ftruncate(fileno(ex->partfp), 0) != 0) {
+			return 0;
 		}
+	}
 
-		if((val = strchr(line, '#'))) {
-			*val = '\0';
+	/* the start of the archive is only on disk. it's extracted from there once
+	 * the rest has arrived, so without the file there's nothing to extract
+	 * from */
+	if(ex->resumed) {
+		return curl_write_partial(t, ptr, realsize) == 0 ? realsize : 0;
+	}
+
+	if(!ex->started) {
+		ret = pthread_create(&ex->thread, NULL, archive_extract_thread, ex);
+		if(ret != 0) {
+			cwr_fprintf(stderr, LOG_ERROR, "failed to spawn new thread: %s\n",
+					strerror(ret));
+			return 0;
 		}
+		ex->started = 1;
+		stats_extract(1);
+	}
 
-		key = val = line;
-		strsep(&val, "=");
-		strtrim(key);
-		strtrim(val);
+	pthread_mutex_lock(&ex->lock);
 
-		if(val && !*val) {
-			val = NULL;
+	/* libarchive stopped reading. trailing padding is fine to drop, but
+	 * there's no sense downloading the rest of a broken archive */
+	if(ex->finished) {
+		pthread_mutex_unlock(&ex->lock);
+		if(ex->ret != 0) {
+			return 0;
 		}
+		curl_write_partial(t, ptr, realsize);
+		return realsize;
+	}
 
-		cwr_printf(LOG_DEBUG, "found config option: %s => %s\n", key, val);
+	/* libarchive hasn't caught up yet. curl will hand us the same data again
+	 * once the transfer is unpaused, so none of it is written anywhere yet */
+	if(ex->full) {
+		ex->paused = 1;
+		pthread_mutex_unlock(&ex->lock);
+		cwr_printf(LOG_DEBUG, "[%s]: extraction fell behind, pausing transfer\n",
+				t->label);
+		return CURL_WRITEFUNC_PAUSE;
+	}
 
-		/* colors are not initialized in this section, so usage of cwr_printf
-		 * functions is verboten unless we're using loglevel_t LOG_DEBUG */
-		if(STREQ(key, "IgnoreRepo")) {
-			for(key = strtok(val, " "); key; key = strtok(NULL, " ")) {
-				cwr_printf(LOG_DEBUG, "ignoring repo: %s\n", key);
-				cfg.ignore.repos = alpm_list_add(cfg.ignore.repos, strdup(key));
-			}
-		} else if(STREQ(key, "IgnorePkg")) {
-			for(key = strtok(val, " "); key; key = strtok(NULL, " ")) {
-				cwr_printf(LOG_DEBUG, "ignoring package: %s\n", key);
-				cfg.ignore.pkgs = alpm_list_add(cfg.ignore.pkgs, strdup(key));
-			}
-		} else if(STREQ(key, "IgnoreOOD")) {
-			if(cfg.ignoreood == UNSET) {
-				cfg.ignoreood = 1;
-			}
-		} else if(STREQ(key, "TargetDir")) {
-			if(val && !cfg.dlpath) {
-				wordexp_t p;
-				if(wordexp(val, &p, 0) == 0) {
-					if(p.we_wordc == 1) {
-						cfg.dlpath = strdup(p.we_wordv[0]);
-					}
-					wordfree(&p);
-					/* error on relative paths */
-					if(*cfg.dlpath != '/') {
-						fprintf(stderr, "error: TargetDir cannot be a relative path\n");
-						ret = 1;
-					}
-				} else {
-					fprintf(stderr, "error: failed to resolve option to TargetDir\n");
-					ret = 1;
-				}
-			}
-		} else if(STREQ(key, "MaxThreads")) {
-			if(val && cfg.maxthreads == UNSET) {
-				cfg.maxthreads = strtol(val, &key, 10);
-				if(*key != '\0' || cfg.maxthreads <= 0) {
-					fprintf(stderr, "error: invalid option to MaxThreads: %s\n", val);
-					ret = 1;
-				}
-			}
-		} else if(STREQ(key, "ConnectTimeout")) {
-			if(val && cfg.timeout == UNSET) {
-				cfg.timeout = strtol(val, &key, 10);
-				if(*key != '\0' || cfg.timeout < 0) {
-					fprintf(stderr, "error: invalid option to ConnectTimeout: %s\n", val);
-					ret = 1;
-				}
-			}
-		} else if(STREQ(key, "Color")) {
-			if(cfg.color == UNSET) {
-				if(!val || STREQ(val, "auto")) {
-					if(isatty(fileno(stdout))) {
-						cfg.color = 1;
-					} else {
-						cfg.color = 0;
-					}
-				} else if(STREQ(val, "always")) {
-					cfg.color = 1;
-				} else if(STREQ(val, "never")) {
-					cfg.color = 0;
-				} else {
-					fprintf(stderr, "error: invalid option to Color\n");
-					return 1;
-				}
+	if(realsize > ex->chunkmax) {
+		void *newchunk = realloc(ex->chunk, realsize);
+		if(!newchunk) {
+			pthread_mutex_unlock(&ex->lock);
+			ALLOC_FAIL(realsize);
+			return 0;
+		}
+		ex->chunk = newchunk;
+		ex->chunkmax = realsize;
+	}
+
+	memcpy(ex->chunk, ptr, realsize);
+	ex->chunksz = realsize;
+	ex->full = 1;
+	pthread_cond_signal(&ex->cond);
+
+	pthread_mutex_unlock(&ex->lock);
+
+	/* only now that curl won't deliver this chunk again */
+	curl_write_partial(t, ptr, realsize);
+
+	return realsize;
+} /* }}} */
+
+size_t curl_write_response(void *ptr, size_t size, size_t nmemb, void *stream) /* {{{ */
+{
+	size_t realsize = size * nmemb;
+	struct transfer_t *t = stream;
+	struct response_t *mem = &t->response;
+
+	/* make room for the whole body up front if the server told us its size */
+	if(mem->size == 0) {
+#if LIBCURL_VERSION_NUM >= 0x073700
+		curl_off_t length = -1;
+		curl_easy_getinfo(t->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+#else
+		double length = -1;
+		curl_easy_getinfo(t->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &length);
+#endif
+		if(length > 0) {
+			response_reserve(mem, (size_t)length + 1);
+		}
+	}
+
+	if(response_reserve(mem, mem->size + realsize + 1) != 0) {
+		return 0;
+	}
+
+	memcpy(&(mem->data[mem->size]), ptr, realsize);
+	mem->size += realsize;
+	mem->data[mem->size] = '\0';
+
+	return realsize;
+} /* }}} */
+
+void download(void *arg) /* {{{ */
+{
+	char *url, *escaped;
+
+	escaped = url_escape(arg, 0, NULL);
+	cwr_asprintf(&url, AUR_RPC_URL, cfg.aururl, AUR_QUERY_TYPE_INFO, escaped);
+	curl_free(escaped);
+
+	curl_get_url_as_pkglist(url, arg, download_query_cb, arg);
+	free(url);
+} /* }}} */
+
+void download_done(struct transfer_t *t, CURLcode curlstat) /* {{{ */
+{
+	alpm_list_t *queryresult = t->data;
+	struct aurpkg_t *result = queryresult->data;
+	struct extract_t *ex = t->extract;
+	const char *arg = t->label;
+	long httpcode;
+
+	/* wait for libarchive to finish with the last chunk */
+	if(ex->started) {
+		pthread_mutex_lock(&ex->lock);
+		ex->eof = 1;
+		pthread_cond_signal(&ex->cond);
+		pthread_mutex_unlock(&ex->lock);
+		pthread_join(ex->thread, NULL);
+		ex->started = 0;
+		stats_extract(0);
+	}
+
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	cwr_printf(LOG_DEBUG, "[%s]: server responded with %ld\n", arg, httpcode);
+
+	/* a whole archive goes into the cache. one cut off by the network is kept
+	 * for the next run to resume, and anything else is of no use. */
+	if(ex->partfp) {
+		int ok = fclose(ex->partfp) == 0 && (httpcode == 200 || httpcode == 206);
+
+		ex->partfp = NULL;
+		if(ok && curlstat == CURLE_OK && ex->ret == 0) {
+			if(rename(ex->partial, ex->tarball) == 0) {
+				cache_tarball_prune(result, ex->tarball);
+			} else {
+				unlink(ex->partial);
+				ex->resumed = 0;
 			}
-		} else {
-			fprintf(stderr, "ignoring unknown option: %s\n", key);
+		} else if(!ok || curlstat == CURLE_OK || curlstat == CURLE_WRITE_ERROR) {
+			unlink(ex->partial);
 		}
-		if(ret > 0) {
+	}
+
+	/* a failed extraction aborts the transfer with a write error, so report
+	 * whichever of the two actually went wrong first */
+	if(curlstat != CURLE_OK && (curlstat != CURLE_WRITE_ERROR || ex->ret == 0)) {
+		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", arg);
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", arg, curl_easy_strerror(curlstat));
+		goto finish;
+	}
+
+	switch(httpcode) {
+		case 200:
+		case 206:
+			break;
+		default:
+			cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", arg);
+			cwr_fprintf(stderr, LOG_ERROR, "[%s]: server responded with HTTP %ld\n",
+					arg, httpcode);
 			goto finish;
+	}
+
+	/* the rest of a resumed download is only on disk */
+	if(ex->resumed) {
+		stats_extract(1);
+		ex->ret = archive_extract_file(NULL, ex->tarball, &ex->subdir);
+		ex->finished = 1;
+		stats_extract(0);
+		if(ex->ret != 0) {
+			unlink(ex->tarball);
 		}
 	}
 
+	if(!ex->finished) {
+		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", arg);
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: failed to extract tarball: empty response\n",
+				arg);
+		goto finish;
+	}
+
+	download_extracted(arg, queryresult, ex->ret, ex->subdir);
+	return;
+
 finish:
-	fclose(fp);
-	return ret;
+	results = alpm_list_join(results, queryresult);
+} /* }}} */
+
+void download_extracted(const char *arg, alpm_list_t *queryresult, int ret, /* {{{ */
+		const char *subdir)
+{
+	struct aurpkg_t *result = queryresult->data;
+
+	if(ret != 0) {
+		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", arg);
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: failed to extract tarball: %s\n",
+				arg, strerror(ret));
+	} else {
+		cwr_printf(LOG_BRIEF, BRIEF_OK "\t%s\t", result->name);
+		cwr_printf(LOG_INFO, "%s%s%s downloaded to %s\n",
+				colstr->pkg, result->name, colstr->nc, cfg.dlpath);
+
+		if(cfg.getdeps) {
+			resolve_dependencies(arg, subdir);
+		}
+	}
+
+	results = alpm_list_join(results, queryresult);
+} /* }}} */
+
+void download_query_cb(void *pkglist, void *arg) /* {{{ */
+{
+	alpm_list_t *queryresult = pkglist;
+	struct aurpkg_t *result;
+	struct transfer_t *t;
+	char *url, *escaped, *tarball = NULL;
+	struct stat st;
+
+	if(!queryresult) {
+		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
+		cwr_fprintf(stderr, LOG_ERROR, "no results found for %s\n", (const char*)arg);
+		return;
+	}
+
+	if(access(arg, F_OK) == 0 && !cfg.force) {
+		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_ERR "\t%s\t", (const char*)arg);
+		cwr_fprintf(stderr, LOG_ERROR, "`%s/%s' already exists. Use -f to overwrite.\n",
+				cfg.dlpath, (const char*)arg);
+		alpm_list_free_inner(queryresult, aurpkg_free);
+		alpm_list_free(queryresult);
+		return;
+	}
+
+	result = queryresult->data;
+
+	/* the same upload was fetched before. nothing to ask the AUR for. */
+	if(cfg.cachedir && (tarball = cache_tarball_path(result)) &&
+			access(tarball, R_OK) == 0) {
+		char *subdir = NULL;
+		int ret;
+
+		cwr_printf(LOG_DEBUG, "[%s]: extracting cached tarball %s\n",
+				(const char*)arg, tarball);
+		stats_extract(1);
+		ret = archive_extract_file(NULL, tarball, &subdir);
+		stats_extract(0);
+		if(ret != 0) {
+			unlink(tarball);
+		}
+
+		download_extracted(arg, queryresult, ret, subdir);
+		free(subdir);
+		free(tarball);
+		return;
+	}
+
+	escaped = url_escape(result->urlpath, 0, "/");
+	cwr_asprintf(&url, AUR_BASE_URL, cfg.aururl, escaped);
+	free(escaped);
+
+	t = transfer_new(url, arg, download_done);
+	free(url);
+	if(!t) {
+		goto error;
+	}
+
+	CALLOC(t->extract, 1, sizeof(struct extract_t), goto error);
+	pthread_mutex_init(&t->extract->lock, NULL);
+	pthread_cond_init(&t->extract->cond, NULL);
+	t->extract->transfer = t;
+
+	/* the download is kept alongside the extraction. part of one left over
+	 * from an interrupted run only needs the rest fetched. */
+	if(tarball && cwr_asprintf(&t->extract->partial, "%s.part", tarball) != -1) {
+		t->extract->tarball = tarball;
+		tarball = NULL;
+
+		if(stat(t->extract->partial, &st) == 0 && st.st_size > 0) {
+			cwr_printf(LOG_DEBUG, "[%s]: resuming download at %lld bytes\n",
+					(const char*)arg, (long long)st.st_size);
+			t->extract->partfp = fopen(t->extract->partial, "a");
+			t->extract->resumed = t->extract->partfp != NULL;
+			if(t->extract->resumed) {
+				curl_easy_setopt(t->curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)st.st_size);
+			}
+		} else {
+			t->extract->partfp = fopen(t->extract->partial, "w");
+		}
+	}
+	free(tarball);
+
+	t->data = queryresult;
+	curl_easy_setopt(t->curl, CURLOPT_ENCODING, "identity"); /* disable compression */
+	curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t);
+	curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, curl_write_archive);
+
+	transfer_start(t);
+	return;
+
+error:
+	free(tarball);
+	transfer_free(t);
+	alpm_list_free_inner(queryresult, aurpkg_free);
+	alpm_list_free(queryresult);
+} /* }}} */
+
+void feed_free(void) /* {{{ */
+{
+	FREE(feed.carry.data);
+	memset(&feed, 0, sizeof(feed));
+} /* }}} */
+
+void feed_read(void) /* {{{ */
+{
+	char block[FEED_BLOCKSIZE];
+	alpm_list_t *fresh = NULL, *i;
+	ssize_t len;
+
+	/* only called once poll says there's something to read, so this won't
+	 * stall the transfers already on the wire */
+	len = read(STDIN_FILENO, block, sizeof(block));
+	if(len < 0) {
+		if(errno == EINTR || errno == EAGAIN) {
+			return;
+		}
+		cwr_fprintf(stderr, LOG_ERROR, "failed to read targets from stdin: %s\n",
+				strerror(errno));
+		len = 0;
+	}
+	if(len == 0) {
+		feed.eof = 1;
+	}
+
+	targets_parse(&feed.carry, block, len, &fresh, &targetset);
+	for(i = fresh; i; i = alpm_list_next(i)) {
+		workq_push(i->data);
+	}
+	alpm_list_free(fresh);
+} /* }}} */
+
+void filter_free(void) /* {{{ */
+{
+	int i;
+
+	for(i = 0; i < searchfilter.count; i++) {
+		regfree(&searchfilter.regex[i]);
+	}
+	FREE(searchfilter.regex);
+	strset_free(&searchfilter.kept);
+} /* }}} */
+
+int filter_init(void) /* {{{ */
+{
+	const alpm_list_t *i;
+
+	if(!(cfg.opmask & OP_SEARCH)) {
+		return 0;
+	}
+
+	CALLOC(searchfilter.regex, alpm_list_count(cfg.targets), sizeof(regex_t), return 1);
+	for(i = cfg.targets; i; i = alpm_list_next(i)) {
+		if(regcomp(&searchfilter.regex[searchfilter.count], i->data, REGEX_OPTS) != 0) {
+			/* nothing can match every term now */
+			searchfilter.nomatch = 1;
+			continue;
+		}
+		searchfilter.count++;
+	}
+
+	return 0;
+} /* }}} */
+
+int filter_pkg(const struct aurpkg_t *pkg) /* {{{ */
+{
+	int i;
+
+	if(!(cfg.opmask & OP_SEARCH)) {
+		return 1;
+	}
+
+	if(searchfilter.nomatch) {
+		return 0;
+	}
+
+	for(i = 0; i < searchfilter.count; i++) {
+		if(regexec(&searchfilter.regex[i], pkg->name, 0, 0, 0) == REG_NOMATCH &&
+				(!pkg->desc ||
+				 regexec(&searchfilter.regex[i], pkg->desc, 0, 0, 0) == REG_NOMATCH)) {
+			return 0;
+		}
+	}
+
+	/* a package matching every term is likely in the response for every term.
+	 * only the first copy is kept */
+	return strset_add(&searchfilter.kept, pkg->name) != 0;
+} /* }}} */
+
+int format_compile(const char *format) /* {{{ */
+{
+	const char *p;
+	char *text;
+	struct fmtop_t *run = NULL;
+	size_t len = strlen(format);
+
+	/* neither the number of ops nor the unescaped literals can outgrow the
+	 * format string itself */
+	CALLOC(fmtprog.ops, len + 1, sizeof(struct fmtop_t), return 1);
+	MALLOC(fmtprog.text, len + 1, return 1);
+	text = fmtprog.text;
+
+	for(p = format; *p; p++) {
+		char c;
+
+		if(*p == '%') {
+			struct fmtop_t *op;
+			int ljust = 0, width = 0;
+
+			for(p++; *p && strchr(printf_flags, *p); p++) {
+				if(*p == '-') {
+					ljust = 1;
+				}
+			}
+			for(; *p && strchr(digits, *p); p++) {
+				width = width * 10 + (*p - '0');
+			}
+
+			if(*p && strchr(format_fields, *p)) {
+				op = &fmtprog.ops[fmtprog.count++];
+				op->conv = *p;
+				op->width = width;
+				op->ljust = ljust;
+				run = NULL;
+				continue;
+			}
+
+			/* anything else, including a trailing %, prints a placeholder */
+			c = *p == '%' ? '%' : '?';
+			if(!*p) {
+				p--;
+			}
+		} else if(*p == '\\') {
+			if(!*++p) {
+				break;
+			}
+			c = unescape_char(*p);
+			if(!c) {
+				continue;
+			}
+		} else {
+			c = *p;
+		}
+
+		if(!run) {
+			run = &fmtprog.ops[fmtprog.count++];
+			run->literal = text;
+		}
+		*text++ = c;
+		run->literalsz++;
+	}
+
+	return 0;
+} /* }}} */
+
+void format_free(void) /* {{{ */
+{
+	FREE(fmtprog.ops);
+	FREE(fmtprog.text);
+	fmtprog.count = 0;
+} /* }}} */
+
+int getcols(void) /* {{{ */
+{
+	int termwidth = -1;
+	const int default_tty = 80;
+	const int default_notty = 0;
+
+	/* only ask once. this is called for every wrapped line of output */
+	if(termcols >= 0) {
+		return termcols;
+	}
+
+	if(!isatty(fileno(stdout))) {
+		termcols = default_notty;
+		return termcols;
+	}
+
+#ifdef TIOCGSIZE
+	struct ttysize win;
+	if(ioctl(1, TIOCGSIZE, &win) == 0) {
+		termwidth = win.ts_cols;
+	}
+#elif defined(TIOCGWINSZ)
+	struct winsize win;
+	if(ioctl(1, TIOCGWINSZ, &win) == 0) {
+		termwidth = win.ws_col;
+	}
+#endif
+	termcols = termwidth <= 0 ? default_tty : termwidth;
+	return termcols;
+} /* }}} */
+
+char *get_file_as_buffer(const char *path) /* {{{ */
+{
+	FILE *fp;
+	char *buf;
+	long fsize, nread;
+
+	fp = fopen(path, "r");
+	if(!fp) {
+		cwr_fprintf(stderr, LOG_ERROR, "error: failed to open %s: %s\n",
+				path, strerror(errno));
+		return NULL;
+	}
+
+	fseek(fp, 0L, SEEK_END);
+	fsize = ftell(fp);
+	fseek(fp, 0L, SEEK_SET);
+
+	CALLOC(buf, 1, (ssize_t)fsize + 1, return NULL);
+
+	nread = fread(buf, 1, fsize, fp);
+	fclose(fp);
+
+	if(nread < fsize) {
+		cwr_fprintf(stderr, LOG_ERROR, "Failed to read full PKGBUILD\n");
+		return NULL;
+	}
+
+	return buf;
+} /* }}} */
+
+char *get_file_as_map(const char *path, size_t *len) /* {{{ */
+{
+	struct stat st;
+	char *buf;
+	long pagesize = sysconf(_SC_PAGESIZE);
+	int fd;
+
+	/* a private, writable mapping can be tokenized in place just like a
+	 * buffer. the tail of the last page reads as zeroes, and that's the
+	 * terminator. a file that fills its last page has no room for one, so
+	 * it's read the old way and *len is left at 0 */
+	*len = 0;
+
+	fd = open(path, O_RDONLY|O_CLOEXEC);
+	if(fd < 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "error: failed to open %s: %s\n",
+				path, strerror(errno));
+		return NULL;
+	}
+
+	if(fstat(fd, &st) != 0 || st.st_size == 0 || pagesize <= 0 ||
+			st.st_size % pagesize == 0) {
+		close(fd);
+		return get_file_as_buffer(path);
+	}
+
+	buf = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(buf == MAP_FAILED) {
+		return get_file_as_buffer(path);
+	}
+
+	*len = st.st_size;
+
+	return buf;
+} /* }}} */
+
+int get_cache_path(char *cache_path, size_t pathlen) /* {{{ */
+{
+	char *var;
+	struct passwd *pwd;
+
+	var = getenv("XDG_CACHE_HOME");
+	if(var != NULL) {
+		snprintf(cache_path, pathlen, "%s/cower", var);
+		return 0;
+	}
+
+	var = getenv("HOME");
+	if(var != NULL) {
+		snprintf(cache_path, pathlen, "%s/.cache/cower", var);
+		return 0;
+	}
+
+	pwd = getpwuid(getuid());
+	if(pwd != NULL && pwd->pw_dir != NULL) {
+		snprintf(cache_path, pathlen, "%s/.cache/cower", pwd->pw_dir);
+		return 0;
+	}
+
+	return 1;
+} /* }}} */
+
+int get_config_path(char *config_path, size_t pathlen) /* {{{ */
+{
+	char *var;
+	struct passwd *pwd;
+
+	var = getenv("XDG_CONFIG_HOME");
+	if(var != NULL) {
+		snprintf(config_path, pathlen, "%s/cower/config", var);
+		return 0;
+	}
+
+	var = getenv("HOME");
+	if(var != NULL) {
+		snprintf(config_path, pathlen, "%s/.config/cower/config", var);
+		return 0;
+	}
+
+	pwd = getpwuid(getuid());
+	if(pwd != NULL && pwd->pw_dir != NULL) {
+		snprintf(config_path, pathlen, "%s/.config/cower/config", pwd->pw_dir);
+		return 0;
+	}
+
+	return 1;
+} /* }}} */
+
+int get_socket_path(char *path, size_t pathlen) /* {{{ */
+{
+	char *var;
+
+	var = getenv("XDG_RUNTIME_DIR");
+	if(var != NULL) {
+		snprintf(path, pathlen, "%s/" SOCKET_NAME, var);
+	} else if(get_cache_path(path, pathlen) == 0) {
+		strncat(path, "/" SOCKET_NAME, pathlen - strlen(path) - 1);
+	} else {
+		return 1;
+	}
+
+	/* a truncated path would quietly name some other socket */
+	return strlen(path) + 1 >= pathlen;
+} /* }}} */
+
+void indentprint(const char *str, int indent) /* {{{ */
+{
+	const char *p;
+	int cidx, cols;
+
+	if(!str) {
+		return;
+	}
+
+	cols = getcols();
+
+	/* if we're not a tty, print without indenting */
+	if(cols == 0) {
+		outbuf_puts(str);
+		return;
+	}
+
+	p = str;
+	cidx = indent;
+
+	while(*p) {
+		size_t n;
+		int width;
+
+		if(*p == ' ') {
+			const char *q, *next;
+			int len = 0;
+
+			p++;
+			if(*p == ' ') {
+				continue;
+			}
+			next = strchrnul(p, ' ');
+
+			/* len captures # cols */
+			for(q = p; q < next; q += n) {
+				n = mbchar_width(q, &width);
+				len += width;
+			}
+
+			if(len > (cols - cidx - 1)) {
+				/* wrap to a newline and reindent */
+				outbuf_putc('\n');
+				outbuf_pad(indent);
+				cidx = indent;
+			} else {
+				outbuf_putc(' ');
+				cidx++;
+			}
+			continue;
+		}
+
+		n = mbchar_width(p, &width);
+		outbuf_write(p, n);
+		cidx += width;
+		p += n;
+	}
+} /* }}} */
+
+void index_list_done(struct transfer_t *t, CURLcode curlstat) /* {{{ */
+{
+	alpm_list_t **names = t->data;
+	struct archive *archive;
+	struct archive_entry *entry;
+	struct response_t list = { NULL, 0, 0 };
+	char *line, *saveptr;
+	ssize_t len = 0;
+	long httpcode;
+
+	if(curlstat != CURLE_OK) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", t->label, curl_easy_strerror(curlstat));
+		return;
+	}
+
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	if(httpcode != 200) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: server responded with HTTP %ld\n",
+				t->label, httpcode);
+		return;
+	}
+
+	/* the list is served as a plain gzip file, not with a compressed
+	 * transfer encoding, so curl hands it over as is */
+	archive = archive_read_new();
+	archive_read_support_filter_all(archive);
+	archive_read_support_format_raw(archive);
+
+	if(archive_read_open_memory(archive, t->response.data, t->response.size) != ARCHIVE_OK ||
+			archive_read_next_header(archive, &entry) != ARCHIVE_OK) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", t->label, archive_error_string(archive));
+		archive_read_free(archive);
+		return;
+	}
+
+	while(response_reserve(&list, list.size + BUFSIZE_MIN + 1) == 0) {
+		len = archive_read_data(archive, list.data + list.size, list.capacity - list.size - 1);
+		if(len <= 0) {
+			break;
+		}
+		list.size += len;
+	}
+
+	if(len < 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", t->label, archive_error_string(archive));
+	} else if(list.data) {
+		list.data[list.size] = '\0';
+		for(line = strtok_r(list.data, "\n", &saveptr); line;
+				line = strtok_r(NULL, "\n", &saveptr)) {
+			if(*line != '#') {
+				*names = alpm_list_add(*names, strdup(line));
+			}
+		}
+	}
+
+	archive_read_close(archive);
+	archive_read_free(archive);
+	response_release(&list);
+} /* }}} */
+
+int index_parse_record(char *line, struct aurpkg_t *pkg) /* {{{ */
+{
+	char *fields[INDEX_NFIELDS], **str[] = {
+		&pkg->name, &pkg->ver, &pkg->maint, &pkg->urlpath, &pkg->url, &pkg->lic, &pkg->desc
+	};
+	int n;
+
+	memset(pkg, 0, sizeof(struct aurpkg_t));
+
+	for(n = 0; n < INDEX_NFIELDS; n++) {
+		fields[n] = line;
+		line = strchr(line, '\t');
+		if(!line) {
+			break;
+		}
+		*line++ = '\0';
+	}
+
+	/* too few fields, or too many */
+	if(n != INDEX_NFIELDS - 1) {
+		return 1;
+	}
+
+	pkg->id = (int)strtol(fields[0], NULL, 10);
+	pkg->cat = (int)strtol(fields[1], NULL, 10);
+	pkg->votes = (int)strtol(fields[2], NULL, 10);
+	pkg->ood = (int)strtol(fields[3], NULL, 10);
+	pkg->firstsub = (time_t)strtoll(fields[4], NULL, 10);
+	pkg->lastmod = (time_t)strtoll(fields[5], NULL, 10);
+
+	for(n = 0; n < (int)(sizeof(str) / sizeof(str[0])); n++) {
+		*str[n] = *fields[n + 6] ? fields[n + 6] : NULL;
+	}
+
+	return pkg->name ? 0 : 1;
+} /* }}} */
+
+void index_put_string(FILE *fp, const char *str) /* {{{ */
+{
+	size_t len;
+
+	if(!str) {
+		return;
+	}
+
+	/* a record is one line of tab separated fields. descriptions are free form,
+	 * so flatten anything that would break that */
+	while(*str) {
+		len = strcspn(str, "\t\r\n");
+		fwrite(str, 1, len, fp);
+		str += len;
+		if(*str) {
+			fputc(' ', fp);
+			str++;
+		}
+	}
+} /* }}} */
+
+int index_search(void) /* {{{ */
+{
+	char cache_path[PATH_MAX], *path, *map;
+	const char *p, *eol, *end;
+	struct response_t line = { NULL, 0, 0 };
+	struct arena_t *arena;
+	struct stat st;
+	int fd, ret = 0;
+
+	if(get_cache_path(cache_path, sizeof(cache_path)) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "unable to determine cache directory\n");
+		return 1;
+	}
+
+	if(cwr_asprintf(&path, "%s/" INDEX_FILE, cache_path) == -1) {
+		return 1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if(fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < strlen(INDEX_HEADER)) {
+		cwr_fprintf(stderr, LOG_ERROR, "no package index found at %s (run cower --sync-index)\n",
+				path);
+		if(fd >= 0) {
+			close(fd);
+		}
+		free(path);
+		return 1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to map %s: %s\n", path, strerror(errno));
+		free(path);
+		return 1;
+	}
+
+	if(memcmp(map, INDEX_HEADER, strlen(INDEX_HEADER)) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "%s was written by a different version of cower "
+				"(run cower --sync-index)\n", path);
+		munmap(map, st.st_size);
+		free(path);
+		return 1;
+	}
+	free(path);
+
+	arena = arena_new();
+	if(!arena) {
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	end = map + st.st_size;
+	for(p = map + strlen(INDEX_HEADER); p < end; p = eol + 1) {
+		struct aurpkg_t scratch, *pkg;
+		size_t len;
+
+		eol = memchr(p, '\n', end - p);
+		if(!eol) {
+			eol = end;
+		}
+		len = eol - p;
+
+		/* regexec wants terminated strings, and the map is read only */
+		if(response_reserve(&line, len + 1) != 0) {
+			ret = 1;
+			break;
+		}
+		memcpy(line.data, p, len);
+		line.data[len] = '\0';
+
+		if(index_parse_record(line.data, &scratch) != 0) {
+			continue;
+		}
+
+		if(scratch.ood && cfg.ignoreood) {
+			continue;
+		}
+
+		if(cfg.opmask & OP_MSEARCH) {
+			if(!scratch.maint || !strset_contains(&targetset, scratch.maint)) {
+				continue;
+			}
+		} else if(!filter_pkg(&scratch)) {
+			continue;
+		}
+
+		/* it's a keeper. move it off the line buffer */
+		scratch.arena = arena;
+		scratch.name = arena_strdup(arena, scratch.name);
+#define COPY_FIELD(f) scratch.f = scratch.f ? arena_strdup(arena, scratch.f) : NULL
+		COPY_FIELD(ver);
+		COPY_FIELD(maint);
+		COPY_FIELD(urlpath);
+		COPY_FIELD(url);
+		COPY_FIELD(lic);
+		COPY_FIELD(desc);
+#undef COPY_FIELD
+
+		pkg = aurpkg_dup(&scratch);
+		if(!pkg) {
+			ret = 1;
+			break;
+		}
+
+		if(streaming.printfn) {
+			stream_pkg(pkg);
+		}
+		results = alpm_list_add(results, pkg);
+	}
+
+	arena_release(arena);
+	response_release(&line);
+	munmap(map, st.st_size);
+
+	return ret;
+} /* }}} */
+
+int index_sync(void) /* {{{ */
+{
+	char cache_path[PATH_MAX], *path, *url;
+	alpm_list_t *names = NULL;
+	struct transfer_t *t;
+	struct task_t task = {
+		.printfn = NULL,
+		.taskfn = task_multiinfo,
+		.batched = 1
+	};
+	int ret;
+
+	if(get_cache_path(cache_path, sizeof(cache_path)) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "unable to determine cache directory\n");
+		return 1;
+	}
+
+	if(mkdir_p(cache_path) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to create cache directory %s: %s\n",
+				cache_path, strerror(errno));
+		return 1;
+	}
+
+	if(cwr_asprintf(&url, AUR_PKGLIST_URL, cfg.aururl) == -1) {
+		return 1;
+	}
+	t = transfer_new(url, "packages.gz", index_list_done);
+	free(url);
+	if(!t) {
+		return 1;
+	}
+	t->data = &names;
+	curl_easy_setopt(t->curl, CURLOPT_WRITEFUNCTION, curl_write_response);
+	curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, t);
+	transfer_start(t);
+
+	/* nothing is queued yet, so this only waits for the package list */
+	cwr_printf(LOG_VERBOSE, "fetching the AUR package list...\n");
+	if(transfer_loop(&task) != 0 || !names) {
+		FREELIST(names);
+		return 1;
+	}
+
+	cwr_printf(LOG_VERBOSE, "fetching metadata for %zd packages...\n",
+			alpm_list_count(names));
+
+	/* the index has to hold everything, whatever the config filters out */
+	cfg.ignoreood = 0;
+	cfg.extinfo = 0;
+
+	workq = names;
+	ret = transfer_loop(&task);
+	if(ret == 0) {
+		results = sort_results(results);
+		if(cwr_asprintf(&path, "%s/" INDEX_FILE, cache_path) == -1) {
+			ret = 1;
+		} else {
+			ret = index_write(path, results);
+			if(ret == 0) {
+				cwr_printf(LOG_INFO, "indexed %zd packages in %s\n",
+						alpm_list_count(results), path);
+			}
+			free(path);
+		}
+	}
+
+	FREELIST(names);
+
+	return ret;
+} /* }}} */
+
+int index_write(const char *path, const alpm_list_t *pkgs) /* {{{ */
+{
+	const alpm_list_t *i;
+	char *tmpfile;
+	FILE *fp;
+	int fd;
+
+	if(cwr_asprintf(&tmpfile, "%s.XXXXXX", path) == -1) {
+		return 1;
+	}
+
+	fd = mkstemp(tmpfile);
+	if(fd < 0 || !(fp = fdopen(fd, "w"))) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to open %s: %s\n", tmpfile, strerror(errno));
+		if(fd >= 0) {
+			close(fd);
+			unlink(tmpfile);
+		}
+		free(tmpfile);
+		return 1;
+	}
+
+	fputs(INDEX_HEADER, fp);
+	for(i = pkgs; i; i = alpm_list_next(i)) {
+		const struct aurpkg_t *pkg = i->data;
+
+		fprintf(fp, "%d\t%d\t%d\t%d\t%lld\t%lld\t", pkg->id, pkg->cat, pkg->votes,
+				pkg->ood, (long long)pkg->firstsub, (long long)pkg->lastmod);
+		index_put_string(fp, pkg->name);
+		fputc('\t', fp);
+		index_put_string(fp, pkg->ver);
+		fputc('\t', fp);
+		index_put_string(fp, pkg->maint);
+		fputc('\t', fp);
+		index_put_string(fp, pkg->urlpath);
+		fputc('\t', fp);
+		index_put_string(fp, pkg->url);
+		fputc('\t', fp);
+		index_put_string(fp, pkg->lic);
+		fputc('\t', fp);
+		index_put_string(fp, pkg->desc);
+		fputc('\n', fp);
+	}
+
+	/* searches running alongside a sync keep reading the old index */
+	if(fclose(fp) != 0 || rename(tmpfile, path) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to write %s: %s\n", path, strerror(errno));
+		unlink(tmpfile);
+		free(tmpfile);
+		return 1;
+	}
+
+	free(tmpfile);
+
+	return 0;
+} /* }}} */
+
+int json_end_map(void *ctx) /* {{{ */
+{
+	struct yajl_parser_t *p = ctx;
+
+	p->json_depth--;
+	if(p->json_depth > 0) {
+		if(p->aurpkg->ood && cfg.ignoreood) {
+			aurpkg_free_inner(p->aurpkg);
+		} else if(!filter_pkg(p->aurpkg)) {
+			/* misses a search term, or was already kept for another one */
+			aurpkg_free_inner(p->aurpkg);
+		} else {
+			if(streaming.printfn && !cfg.extinfo) {
+				stream_pkg(p->aurpkg);
+			}
+			/* sorted once, after everything has arrived */
+			p->pkglist = alpm_list_add(p->pkglist, aurpkg_dup(p->aurpkg));
+		}
+	}
+
+	return 1;
+} /* }}} */
+
+int json_integer(void *ctx, long long val) /* {{{ */
+{
+	struct yajl_parser_t *p = ctx;
+
+	switch(p->key) {
+		case JSONKEY_ID:
+			p->aurpkg->id = (int)val;
+			break;
+		case JSONKEY_CAT:
+			p->aurpkg->cat = (int)val;
+			break;
+		case JSONKEY_VOTES:
+			p->aurpkg->votes = (int)val;
+			break;
+		case JSONKEY_OOD:
+			p->aurpkg->ood = (int)val;
+			break;
+		case JSONKEY_FIRSTSUB:
+			p->aurpkg->firstsub = (time_t)val;
+			break;
+		case JSONKEY_LASTMOD:
+			p->aurpkg->lastmod = (time_t)val;
+			break;
+		case JSONKEY_RESULTCOUNT:
+			p->resultcount = (int)val;
+			break;
+		default:
+			break;
+	}
+
+	return 1;
+} /* }}} */
+
+jsonkey_t json_key_lookup(const char *key, size_t size) /* {{{ */
+{
+	if(size == 0) {
+		return JSONKEY_UNKNOWN;
+	}
+
+	/* the first letter leaves at most two candidates, and the length check in
+	 * KEY_IS rules out one of those without touching the key again */
+	switch(*key) {
+		case 'C':
+			return KEY_IS(AUR_CAT) ? JSONKEY_CAT : JSONKEY_UNKNOWN;
+		case 'D':
+			return KEY_IS(AUR_DESC) ? JSONKEY_DESC : JSONKEY_UNKNOWN;
+		case 'F':
+			return KEY_IS(AUR_FIRSTSUB) ? JSONKEY_FIRSTSUB : JSONKEY_UNKNOWN;
+		case 'I':
+			return KEY_IS(AUR_ID) ? JSONKEY_ID : JSONKEY_UNKNOWN;
+		case 'L':
+			if(KEY_IS(AUR_LICENSE)) {
+				return JSONKEY_LICENSE;
+			}
+			return KEY_IS(AUR_LASTMOD) ? JSONKEY_LASTMOD : JSONKEY_UNKNOWN;
+		case 'M':
+			return KEY_IS(PKG_MAINT) ? JSONKEY_MAINT : JSONKEY_UNKNOWN;
+		case 'N':
+			if(KEY_IS(NAME)) {
+				return JSONKEY_NAME;
+			}
+			return KEY_IS(AUR_VOTES) ? JSONKEY_VOTES : JSONKEY_UNKNOWN;
+		case 'O':
+			return KEY_IS(AUR_OOD) ? JSONKEY_OOD : JSONKEY_UNKNOWN;
+		case 'U':
+			if(KEY_IS(URL)) {
+				return JSONKEY_URL;
+			}
+			return KEY_IS(URLPATH) ? JSONKEY_URLPATH : JSONKEY_UNKNOWN;
+		case 'V':
+			return KEY_IS(VERSION) ? JSONKEY_VERSION : JSONKEY_UNKNOWN;
+		case 'r':
+			return KEY_IS(AUR_QUERY_RESULTCOUNT) ? JSONKEY_RESULTCOUNT : JSONKEY_UNKNOWN;
+		case 't':
+			return KEY_IS(AUR_QUERY_TYPE) ? JSONKEY_TYPE : JSONKEY_UNKNOWN;
+		default:
+			return JSONKEY_UNKNOWN;
+	}
+} /* }}} */
+
+int json_map_key(void *ctx, const unsigned char *data, size_t size) /* {{{ */
+{
+	struct yajl_parser_t *p = ctx;
+
+	/* looked up once here instead of on every value */
+	p->key = json_key_lookup((const char*)data, size);
+
+	return 1;
+} /* }}} */
+
+int json_start_map(void *ctx) /* {{{ */
+{
+	struct yajl_parser_t *p = ctx;
+
+	p->json_depth++;
+	if(p->json_depth > 1) {
+		memset(p->aurpkg, 0, sizeof(struct aurpkg_t));
+		p->aurpkg->arena = p->arena;
+	}
+
+	return 1;
+} /* }}} */
+
+int json_string(void *ctx, const unsigned char *data, size_t size) /* {{{ */
+{
+	struct yajl_parser_t *p = ctx;
+	char **key;
+
+	switch(p->key) {
+		case JSONKEY_NAME:
+			key = &p->aurpkg->name;
+			break;
+		case JSONKEY_MAINT:
+			key = &p->aurpkg->maint;
+			break;
+		case JSONKEY_VERSION:
+			key = &p->aurpkg->ver;
+			break;
+		case JSONKEY_DESC:
+			key = &p->aurpkg->desc;
+			break;
+		case JSONKEY_URL:
+			key = &p->aurpkg->url;
+			break;
+		case JSONKEY_URLPATH:
+			key = &p->aurpkg->urlpath;
+			break;
+		case JSONKEY_LICENSE:
+			key = &p->aurpkg->lic;
+			break;
+		case JSONKEY_TYPE:
+			/* the AUR answers a bad query with 200 and an error type. that's not
+			 * an answer worth caching */
+			if(p->json_depth == 1 && size == strlen(AUR_QUERY_ERROR) &&
+					memcmp(data, AUR_QUERY_ERROR, size) == 0) {
+				p->rpcerror = 1;
+			}
+			return 1;
+		default:
+			return 1;
+	}
+
+	/* yajl's buffer only lives until the callback returns, so values are
+	 * copied once into the arena that every package from this response
+	 * shares */
+	*key = arena_strndup(p->arena, (const char*)data, size);
+	if(*key == NULL) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to allocate string: %s\n",
+				strerror(errno));
+	}
+
+	return 1;
+} /* }}} */
+
+void jsongen_integer(const char *key, long long val) /* {{{ */
+{
+	yajl_gen_string(jsongen, (const unsigned char*)key, strlen(key));
+	yajl_gen_integer(jsongen, val);
+} /* }}} */
+
+void jsongen_list(const char *key, const alpm_list_t *list) /* {{{ */
+{
+	const alpm_list_t *i;
+
+	yajl_gen_string(jsongen, (const unsigned char*)key, strlen(key));
+	yajl_gen_array_open(jsongen);
+	for(i = list; i; i = alpm_list_next(i)) {
+		yajl_gen_string(jsongen, i->data, strlen(i->data));
+	}
+	yajl_gen_array_close(jsongen);
+} /* }}} */
+
+void jsongen_string(const char *key, const char *val) /* {{{ */
+{
+	yajl_gen_string(jsongen, (const unsigned char*)key, strlen(key));
+	if(val) {
+		yajl_gen_string(jsongen, (const unsigned char*)val, strlen(val));
+	} else {
+		yajl_gen_null(jsongen);
+	}
+} /* }}} */
+
+int list_add_unique(alpm_list_t **list, struct strset_t *set, const char *str) /* {{{ */
+{
+	char *dup;
+
+	if(strset_add(set, str) == 0) {
+		return 0;
+	}
+
+	dup = strdup(str);
+	if(!dup) {
+		ALLOC_FAIL(strlen(str) + 1);
+		return 0;
+	}
+	*list = alpm_list_add(*list, dup);
+
+	return 1;
+} /* }}} */
+
+size_t mbchar_width(const char *s, int *width) /* {{{ */
+{
+	mbstate_t ps;
+	wchar_t wc;
+	size_t n;
+
+	/* descriptions are nearly always plain ASCII, one column per byte */
+	if(!(*s & 0x80)) {
+		*width = 1;
+		return 1;
+	}
+
+	memset(&ps, 0, sizeof(ps));
+	n = mbrtowc(&wc, s, MB_CUR_MAX, &ps);
+	if(n == 0 || n == (size_t)-1 || n == (size_t)-2) {
+		/* not valid in this locale. pass the byte through as is */
+		*width = 1;
+		return 1;
+	}
+
+	*width = wcwidth(wc);
+	if(*width < 0) {
+		*width = 0;
+	}
+
+	return n;
+} /* }}} */
+
+int mkdir_p(char *path) /* {{{ */
+{
+	char *p;
+
+	for(p = strchr(path + 1, '/'); ; p = strchr(p + 1, '/')) {
+		if(p) {
+			*p = '\0';
+		}
+		if(mkdir(path, 0755) != 0 && errno != EEXIST) {
+			if(p) {
+				*p = '/';
+			}
+			return 1;
+		}
+		if(!p) {
+			break;
+		}
+		*p = '/';
+	}
+
+	return 0;
+} /* }}} */
+
+void outbuf_flush(void) /* {{{ */
+{
+	if(outbuf.size) {
+		fwrite(outbuf.data, 1, outbuf.size, stdout);
+		outbuf.size = 0;
+	}
+} /* }}} */
+
+void outbuf_pad(int count) /* {{{ */
+{
+	if(count <= 0 || response_reserve(&outbuf, outbuf.size + count + 1) != 0) {
+		return;
+	}
+
+	memset(&outbuf.data[outbuf.size], ' ', count);
+	outbuf.size += count;
+} /* }}} */
+
+int outbuf_printf(const char *fmt, ...) /* {{{ */
+{
+	va_list args;
+	size_t avail;
+	int len;
+
+	if(response_reserve(&outbuf, outbuf.size + 256) != 0) {
+		return 0;
+	}
+
+	avail = outbuf.capacity - outbuf.size;
+	va_start(args, fmt);
+	len = vsnprintf(&outbuf.data[outbuf.size], avail, fmt, args);
+	va_end(args);
+
+	if(len < 0) {
+		return 0;
+	}
+
+	/* didn't fit. make room and do it again */
+	if((size_t)len >= avail) {
+		if(response_reserve(&outbuf, outbuf.size + len + 1) != 0) {
+			return 0;
+		}
+		va_start(args, fmt);
+		vsnprintf(&outbuf.data[outbuf.size], len + 1, fmt, args);
+		va_end(args);
+	}
+
+	outbuf.size += len;
+
+	return len;
+} /* }}} */
+
+void outbuf_putc(char c) /* {{{ */
+{
+	outbuf_write(&c, 1);
+} /* }}} */
+
+void outbuf_puts(const char *str) /* {{{ */
+{
+	outbuf_write(str, strlen(str));
+} /* }}} */
+
+void outbuf_write(const char *data, size_t len) /* {{{ */
+{
+	if(response_reserve(&outbuf, outbuf.size + len + 1) != 0) {
+		return;
+	}
+
+	memcpy(&outbuf.data[outbuf.size], data, len);
+	outbuf.size += len;
+} /* }}} */
+
+alpm_list_t *parse_bash_array(alpm_list_t *deplist, char *array, pkgdetail_t type,
+		struct arena_t *arena) /* {{{ */
+{
+	char *ptr, *token, *saveptr;
+	struct strset_t seen = { NULL, NULL, 0, 0 };
+	const alpm_list_t *i;
+
+	if(!array) {
+		return NULL;
+	}
+
+	if(type == PKGDETAIL_OPTDEPENDS) {
+		const char *arrayend = rawmemchr(array, '\0');
+		for(token = array; token <= arrayend; token++) {
+			if(*token == '\'' || *token == '\"') {
+				token++;
+				ptr = memchr(token, *(token - 1), arrayend - token);
+				*ptr = '\0';
+			} else if(isalpha(*token)) {
+				ptr = token;
+				while(!isspace(*++ptr));
+				*(ptr - 1) = '\0';
+			} else {
+				continue;
+			}
+
+			strtrim(token);
+			cwr_printf(LOG_DEBUG, "adding depend: %s\n", token);
+			deplist = alpm_list_add(deplist, arena_strdup(arena, token));
+
+			token = ptr;
+		}
+		return deplist;
+	}
+
+	/* the list may already hold entries from another array */
+	for(i = deplist; i; i = alpm_list_next(i)) {
+		strset_add(&seen, i->data);
+	}
+
+	for(token = strtok_r(array, " \t\n", &saveptr); token;
+			token = strtok_r(NULL, " \t\n", &saveptr)) {
+		/* found an embedded comment. skip to the next line */
+		if(*token == '#') {
+			strtok_r(NULL, "\n", &saveptr);
+			continue;
+		}
+
+		/* unquote the element */
+		if(*token == '\'' || *token == '\"') {
+			ptr = strrchr(token + 1, *token);
+			if(ptr) {
+				token++;
+				*ptr = '\0';
+			}
+		}
+
+		/* some people feel compelled to do insane things in PKGBUILDs. these people suck */
+		if(!*token || strlen(token) < 2 || *token == '$') {
+			continue;
+		}
+
+		cwr_printf(LOG_DEBUG, "adding depend: %s\n", token);
+		if(strset_add(&seen, token) != 0) {
+			deplist = alpm_list_add(deplist, arena_strdup(arena, token));
+		}
+	}
+	strset_free(&seen);
+
+	return deplist;
+} /* }}} */
+
+int parse_configfile(void) /* {{{ */
+{
+	char line[BUFSIZ], config_path[PATH_MAX];
+	int ret = 0;
+	FILE *fp;
+
+	if(get_config_path(config_path, sizeof(config_path)) != 0) {
+		return 0;
+	}
+
+	fp = fopen(config_path, "r");
+	if(!fp) {
+		cwr_printf(LOG_DEBUG, "config file not found. skipping parsing\n");
+		return 0; /* not an error, just nothing to do here */
+	}
+
+	while(fgets(line, PATH_MAX, fp)) {
+		char *key, *val;
+		size_t linelen;
+
+		linelen = strtrim(line);
+		if(!linelen || line[0] == '#') {
+			continue;
+		}
+
+		if((val = strchr(line, '#'))) {
+			*val = '\0';
+		}
+
+		key = val = line;
+		strsep(&val, "=");
+		strtrim(key);
+		strtrim(val);
+
+		if(val && !*val) {
+			val = NULL;
+		}
+
+		cwr_printf(LOG_DEBUG, "found config option: %s => %s\n", key, val);
+
+		/* colors are not initialized in this section, so usage of cwr_printf
+		 * functions is verboten unless we're using loglevel_t LOG_DEBUG */
+		if(STREQ(key, "IgnoreRepo")) {
+			for(key = strtok(val, " "); key; key = strtok(NULL, " ")) {
+				cwr_printf(LOG_DEBUG, "ignoring repo: %s\n", key);
+				cfg.ignore.repos = alpm_list_add(cfg.ignore.repos, strdup(key));
+			}
+		} else if(STREQ(key, "IgnorePkg")) {
+			for(key = strtok(val, " "); key; key = strtok(NULL, " ")) {
+				cwr_printf(LOG_DEBUG, "ignoring package: %s\n", key);
+				strset_add(&cfg.ignore.pkgs, key);
+			}
+		} else if(STREQ(key, "IgnoreOOD")) {
+			if(cfg.ignoreood == UNSET) {
+				cfg.ignoreood = 1;
+			}
+		} else if(STREQ(key, "TargetDir")) {
+			if(val && !cfg.dlpath) {
+				wordexp_t p;
+				if(wordexp(val, &p, 0) == 0) {
+					if(p.we_wordc == 1) {
+						cfg.dlpath = strdup(p.we_wordv[0]);
+					}
+					wordfree(&p);
+					/* error on relative paths */
+					if(*cfg.dlpath != '/') {
+						fprintf(stderr, "error: TargetDir cannot be a relative path\n");
+						ret = 1;
+					}
+				} else {
+					fprintf(stderr, "error: failed to resolve option to TargetDir\n");
+					ret = 1;
+				}
+			}
+		} else if(STREQ(key, "MaxThreads")) {
+			if(val && cfg.maxthreads == UNSET) {
+				cfg.maxthreads = strtol(val, &key, 10);
+				if(*key != '\0' || cfg.maxthreads <= 0) {
+					fprintf(stderr, "error: invalid option to MaxThreads: %s\n", val);
+					ret = 1;
+				}
+			}
+		} else if(STREQ(key, "AURURL")) {
+			if(val && !cfg.aururl) {
+				cfg.aururl = strdup(val);
+			}
+		} else if(STREQ(key, "CacheTTL")) {
+			if(val && cfg.cachettl == UNSET) {
+				cfg.cachettl = strtol(val, &key, 10);
+				if(*key != '\0' || cfg.cachettl < 0) {
+					fprintf(stderr, "error: invalid option to CacheTTL: %s\n", val);
+					ret = 1;
+				}
+			}
+		} else if(STREQ(key, "ConnectTimeout")) {
+			if(val && cfg.timeout == UNSET) {
+				cfg.timeout = strtol(val, &key, 10);
+				if(*key != '\0' || cfg.timeout < 0) {
+					fprintf(stderr, "error: invalid option to ConnectTimeout: %s\n", val);
+					ret = 1;
+				}
+			}
+		} else if(STREQ(key, "Color")) {
+			if(cfg.color == UNSET) {
+				if(!val || STREQ(val, "auto")) {
+					if(isatty(fileno(stdout))) {
+						cfg.color = 1;
+					} else {
+						cfg.color = 0;
+					}
+				} else if(STREQ(val, "always")) {
+					cfg.color = 1;
+				} else if(STREQ(val, "never")) {
+					cfg.color = 0;
+				} else {
+					fprintf(stderr, "error: invalid option to Color\n");
+					return 1;
+				}
+			}
+		} else {
+			fprintf(stderr, "ignoring unknown option: %s\n", key);
+		}
+		if(ret > 0) {
+			goto finish;
+		}
+	}
+
+finish:
+	fclose(fp);
+	return ret;
+} /* }}} */
+
+int parse_options(int argc, char *argv[]) /* {{{ */
+{
+	int opt, option_index = 0;
+
+	static const struct option opts[] = {
+		/* operations */
+		{"download",      no_argument,        0, 'd'},
+		{"info",          no_argument,        0, 'i'},
+		{"msearch",       no_argument,        0, 'm'},
+		{"search",        no_argument,        0, 's'},
+		{"update",        no_argument,        0, 'u'},
+		{"sync-index",    no_argument,        0, OP_SYNCINDEX},
+		{"daemon",        no_argument,        0, OP_DAEMON},
+
+		/* options */
+		{"aur-url",       required_argument,  0, OP_AURURL},
+		{"brief",         no_argument,        0, 'b'},
+		{"cache-ttl",     required_argument,  0, OP_CACHETTL},
+		{"color",         optional_argument,  0, 'c'},
+		{"debug",         no_argument,        0, OP_DEBUG},
+		{"force",         no_argument,        0, 'f'},
+		{"format",        required_argument,  0, OP_FORMAT},
+		{"from-pkgbuild", no_argument,        0, 'p'},
+		{"help",          no_argument,        0, 'h'},
+		{"ignore",        required_argument,  0, OP_IGNOREPKG},
+		{"ignore-ood",    no_argument,        0, 'o'},
+		{"no-ignore-ood", no_argument,        0, OP_NOIGNOREOOD},
+		{"null",          no_argument,        0, '0'},
+		{"offline",       no_argument,        0, OP_OFFLINE},
+		{"ignorerepo",    optional_argument,  0, OP_IGNOREREPO},
+		{"json",          no_argument,        0, OP_JSON},
+		{"listdelim",     required_argument,  0, OP_LISTDELIM},
+		{"quiet",         no_argument,        0, 'q'},
+		{"stats",         optional_argument,  0, OP_STATS},
+		{"stream",        no_argument,        0, OP_STREAM},
+		{"target",        required_argument,  0, 't'},
+		{"threads",       required_argument,  0, OP_THREADS},
+		{"timeout",       required_argument,  0, OP_TIMEOUT},
+		{"verbose",       no_argument,        0, 'v'},
+		{"version",       no_argument,        0, 'V'},
+		{0, 0, 0, 0}
+	};
+
+	while((opt = getopt_long(argc, argv, "0bc::dfhimopqst:uvV", opts, &option_index)) != -1) {
+		char *token;
+
+		switch(opt) {
+			/* operations */
+			case 's':
+				cfg.opmask |= OP_SEARCH;
+				break;
+			case 'u':
+				cfg.opmask |= OP_UPDATE;
+				break;
+			case 'i':
+				if(!(cfg.opmask & OP_INFO)) {
+					cfg.opmask |= OP_INFO;
+				} else {
+					cfg.extinfo |= 1;
+				}
+				break;
+			case 'd':
+				if(!(cfg.opmask & OP_DOWNLOAD)) {
+					cfg.opmask |= OP_DOWNLOAD;
+				} else {
+					cfg.getdeps |= 1;
+				}
+				break;
+			case 'm':
+				cfg.opmask |= OP_MSEARCH;
+				break;
+			case OP_SYNCINDEX:
+				cfg.opmask |= OP_SYNC;
+				break;
+			case OP_DAEMON:
+				cfg.opmask |= OP_SERVE;
+				break;
+
+			/* options */
+			case '0':
+				cfg.json |= 1;
+				cfg.jsondelim = '\0';
+				break;
+			case 'b':
+				cfg.logmask |= LOG_BRIEF;
+				break;
+			case 'c':
+				if(!optarg || STREQ(optarg, "auto")) {
+					if(isatty(fileno(stdout))) {
+						cfg.color = 1;
+					} else {
+						cfg.color = 0;
+					}
+				} else if(STREQ(optarg, "always")) {
+					cfg.color = 1;
+				} else if(STREQ(optarg, "never")) {
+					cfg.color = 0;
+				} else {
+					fprintf(stderr, "invalid argument to --color\n");
+					return 1;
+				}
+				break;
+			case 'f':
+				cfg.force |= 1;
+				break;
+			case 'h':
+				usage();
+				return 1;
+			case 'q':
+				cfg.quiet |= 1;
+				break;
+			case 't':
+				cfg.dlpath = strdup(optarg);
+				break;
+			case 'v':
+				cfg.logmask |= LOG_VERBOSE;
+				break;
+			case 'V':
+				version();
+				return 2;
+			case OP_DEBUG:
+				cfg.logmask |= LOG_DEBUG;
+				break;
+			case OP_AURURL:
+				free(cfg.aururl);
+				cfg.aururl = strdup(optarg);
+				break;
+			case OP_FORMAT:
+				cfg.format = optarg;
+				break;
+			case 'o':
+				cfg.ignoreood = 1;
+				break;
+			case 'p':
+				cfg.frompkgbuild |= 1;
+				break;
+			case OP_IGNOREPKG:
+				for(token = strtok(optarg, ","); token; token = strtok(NULL, ",")) {
+					cwr_printf(LOG_DEBUG, "ignoring package: %s\n", token);
+					strset_add(&cfg.ignore.pkgs, token);
+				}
+				break;
+			case OP_IGNOREREPO:
+				if(!optarg) {
+					cfg.skiprepos |= 1;
+				} else {
+					for(token = strtok(optarg, ","); token; token = strtok(NULL, ",")) {
+						cwr_printf(LOG_DEBUG, "ignoring repos: %s\n", token);
+						cfg.ignore.repos = alpm_list_add(cfg.ignore.repos, strdup(token));
+					}
+				}
+				break;
+			case OP_NOIGNOREOOD:
+				cfg.ignoreood = 0;
+				break;
+			case OP_LISTDELIM:
+				cfg.delim = optarg;
+				break;
+			case OP_STREAM:
+				cfg.stream |= 1;
+				break;
+			case OP_STATS:
+				if(!optarg || STREQ(optarg, "text")) {
+					cfg.stats = STATS_TEXT;
+				} else if(STREQ(optarg, "json")) {
+					cfg.stats = STATS_JSON;
+				} else {
+					fprintf(stderr, "invalid argument to --stats\n");
+					return 1;
+				}
+				break;
+			case OP_JSON:
+				cfg.json |= 1;
+				break;
+			case OP_OFFLINE:
+				cfg.offline |= 1;
+				break;
+			case OP_THREADS:
+				cfg.maxthreads = strtol(optarg, &token, 10);
+				if(*token != '\0' || cfg.maxthreads <= 0) {
+					fprintf(stderr, "error: invalid argument to --threads\n");
+					return 1;
+				}
+				break;
+			case OP_CACHETTL:
+				cfg.cachettl = strtol(optarg, &token, 10);
+				if(*token != '\0' || cfg.cachettl < 0) {
+					fprintf(stderr, "error: invalid argument to --cache-ttl\n");
+					return 1;
+				}
+				break;
+			case OP_TIMEOUT:
+				cfg.timeout = strtol(optarg, &token, 10);
+				if(*token != '\0') {
+					fprintf(stderr, "error: invalid argument to --timeout\n");
+					return 1;
+				}
+				break;
+			case '?':
+			default:
+				return 1;
+		}
+	}
+
+	if(!cfg.opmask) {
+		return 3;
+	}
+
+#define NOT_EXCL(val) (cfg.opmask & (val) && (cfg.opmask & ~(val)))
+	/* check for invalid operation combos */
+	if(NOT_EXCL(OP_INFO) || NOT_EXCL(OP_SEARCH) || NOT_EXCL(OP_MSEARCH) ||
+			NOT_EXCL(OP_UPDATE|OP_DOWNLOAD) || NOT_EXCL(OP_SYNC) || NOT_EXCL(OP_SERVE)) {
+		fprintf(stderr, "error: invalid operation\n");
+		return 2;
+	}
+
+	while(optind < argc) {
+		if(list_add_unique(&cfg.targets, &targetset, argv[optind])) {
+			cwr_printf(LOG_DEBUG, "adding target: %s\n", argv[optind]);
+		}
+		optind++;
+	}
+
+	return 0;
+} /* }}} */
+
+int pkg_is_binary(const char *pkg) /* {{{ */
+{
+	const char *db = alpm_provides_pkg(pkg);
+
+	if(db) {
+		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_WARN "\t%s\t", pkg);
+		cwr_fprintf(stderr, LOG_WARN, "%s%s%s is available in %s%s%s\n",
+				colstr->pkg, pkg, colstr->nc,
+				colstr->repo, db, colstr->nc);
+		return 1;
+	}
+
+	return 0;
+} /* }}} */
+
+void pkgbuild_get_extinfo(char *pkgbuild, alpm_list_t **details[], struct arena_t *arena) /* {{{ */
+{
+	double t0 = stats_now();
+
+	pkgbuild_scan(pkgbuild, details, arena);
+	stats_add(PHASE_PKGBUILD, t0);
+} /* }}} */
+
+void pkgbuild_scan(char *pkgbuild, alpm_list_t **details[], struct arena_t *arena) /* {{{ */
+{
+	/* no stats here. the -p workers call this off the main thread, and time
+	 * themselves */
+	static const struct {
+		const char *name;
+		size_t len;
+	} arrays[PKGDETAIL_MAX] = {
+		{ PKGBUILD_DEPENDS, sizeof(PKGBUILD_DEPENDS) - 1 },
+		{ PKGBUILD_MAKEDEPENDS, sizeof(PKGBUILD_MAKEDEPENDS) - 1 },
+		{ PKGBUILD_OPTDEPENDS, sizeof(PKGBUILD_OPTDEPENDS) - 1 },
+		{ PKGBUILD_PROVIDES, sizeof(PKGBUILD_PROVIDES) - 1 },
+		{ PKGBUILD_CONFLICTS, sizeof(PKGBUILD_CONFLICTS) - 1 },
+		{ PKGBUILD_REPLACES, sizeof(PKGBUILD_REPLACES) - 1 }
+	};
+	char *lineptr, *end;
+
+	if(!pkgbuild) {
+		return;
+	}
+
+	end = rawmemchr(pkgbuild, '\0');
+
+	for(lineptr = pkgbuild; lineptr < end; lineptr++) {
+		char *arrayptr, *arrayend;
+		int depth = 1;
+		pkgdetail_t type;
+
+		while(lineptr < end && (*lineptr == ' ' || *lineptr == '\t')) {
+			lineptr++;
+		}
+
+		/* every array we want has a different first letter */
+		switch(*lineptr) {
+			case 'd':
+				type = PKGDETAIL_DEPENDS;
+				break;
+			case 'm':
+				type = PKGDETAIL_MAKEDEPENDS;
+				break;
+			case 'o':
+				type = PKGDETAIL_OPTDEPENDS;
+				break;
+			case 'p':
+				type = PKGDETAIL_PROVIDES;
+				break;
+			case 'c':
+				type = PKGDETAIL_CONFLICTS;
+				break;
+			case 'r':
+				type = PKGDETAIL_REPLACES;
+				break;
+			default:
+				type = PKGDETAIL_MAX;
+				break;
+		}
+
+		if(type == PKGDETAIL_MAX || !details[type] ||
+				(size_t)(end - lineptr) < arrays[type].len ||
+				memcmp(lineptr, arrays[type].name, arrays[type].len) != 0) {
+			lineptr = memchr(lineptr, '\n', end - lineptr);
+			if(!lineptr) {
+				break;
+			}
+			continue;
+		}
+
+		/* find the matching paren, which may be many lines away */
+		arrayptr = lineptr + arrays[type].len;
+		for(arrayend = arrayptr; depth; arrayend++) {
+			arrayend += strcspn(arrayend, "()");
+			if(*arrayend == '(') {
+				depth++;
+			} else if(*arrayend == ')') {
+				depth--;
+			} else {
+				break;
+			}
+		}
+		if(depth) {
+			/* unterminated array. nothing after this is trustworthy */
+			break;
+		}
+
+		*(arrayend - 1) = '\0';
+		*details[type] = parse_bash_array(*details[type], arrayptr, type, arena);
+
+		lineptr = memchr(arrayend, '\n', end - arrayend);
+		if(!lineptr) {
+			break;
+		}
+	}
+} /* }}} */
+
+void pkgbuilds_collect(void) /* {{{ */
+{
+	alpm_list_t *ready, *i;
+	char drain[64];
+	int remaining;
+
+	if(pkgbuilds.donefd[0] >= 0) {
+		while(read(pkgbuilds.donefd[0], drain, sizeof(drain)) > 0);
+	}
+
+	pthread_mutex_lock(&pkgbuilds.lock);
+	ready = pkgbuilds.ready;
+	pkgbuilds.ready = NULL;
+	remaining = pkgbuilds.remaining;
+	pthread_mutex_unlock(&pkgbuilds.lock);
+
+	/* the same depend named by a hundred PKGBUILDs is only queued once */
+	for(i = ready; i; i = alpm_list_next(i)) {
+		if(strset_add(&targetset, i->data) > 0) {
+			workq_push(i->data);
+		} else {
+			free(i->data);
+		}
+	}
+	alpm_list_free(ready);
+
+	if(remaining == 0) {
+		pkgbuilds_join();
+		pkgbuilds.active = 0;
+	}
+} /* }}} */
+
+void pkgbuilds_free(void) /* {{{ */
+{
+	pkgbuilds_join();
+
+	FREELIST(pkgbuilds.ready);
+	FREELIST(pkgbuilds.files);
+	pkgbuilds.next = NULL;
+	pkgbuilds.remaining = 0;
+	pkgbuilds.active = 0;
+	if(pkgbuilds.donefd[0] >= 0) {
+		close(pkgbuilds.donefd[0]);
+		close(pkgbuilds.donefd[1]);
+		pkgbuilds.donefd[0] = pkgbuilds.donefd[1] = -1;
+	}
+} /* }}} */
+
+void pkgbuilds_join(void) /* {{{ */
+{
+	int n;
+
+	for(n = 0; n < pkgbuilds.nthreads; n++) {
+		pthread_join(pkgbuilds.threads[n], NULL);
+	}
+	pkgbuilds.nthreads = 0;
+
+	/* from the start of the first file to the end of the last one, however
+	 * many workers that took */
+	if(pkgbuilds.started > 0 && pkgbuilds.finished > 0) {
+		stats.phase[PHASE_PKGBUILD] += pkgbuilds.finished - pkgbuilds.started;
+		pkgbuilds.started = pkgbuilds.finished = 0;
+	}
+} /* }}} */
+
+void pkgbuilds_start(alpm_list_t *files) /* {{{ */
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int want, n;
+
+	pkgbuilds.files = pkgbuilds.next = files;
+	pkgbuilds.remaining = alpm_list_count(files);
+	if(!pkgbuilds.remaining) {
+		return;
+	}
+	pkgbuilds.started = stats_now();
+
+	want = ncpu < 1 ? 1 : ncpu > PKGBUILD_THREADS ? PKGBUILD_THREADS : ncpu;
+	if(want > pkgbuilds.remaining) {
+		want = pkgbuilds.remaining;
+	}
+
+	/* the transfer loop only hears about finished files through the pipe.
+	 * without it, or without any threads, parse everything up front */
+	if(pipe2(pkgbuilds.donefd, O_NONBLOCK|O_CLOEXEC) != 0) {
+		pkgbuilds.donefd[0] = pkgbuilds.donefd[1] = -1;
+	}
+
+	for(n = 0; n < want; n++) {
+		if(pthread_create(&pkgbuilds.threads[n], NULL, pkgbuilds_work, NULL) != 0) {
+			break;
+		}
+	}
+	pkgbuilds.nthreads = n;
+
+	if(n == 0) {
+		pkgbuilds_work(NULL);
+		pkgbuilds_join();
+	} else if(pkgbuilds.donefd[0] < 0) {
+		pkgbuilds_join();
+	}
+
+	pkgbuilds.active = 1;
+} /* }}} */
+
+void *pkgbuilds_work(void UNUSED *arg) /* {{{ */
+{
+	/* files are claimed one at a time, so a few huge PKGBUILDs don't hold up
+	 * all of the small ones behind them */
+	for(;;) {
+		alpm_list_t *depends = NULL, *fresh = NULL, *i;
+		alpm_list_t **pkg_details[PKGDETAIL_MAX] = {
+			&depends, &depends, NULL, NULL, NULL, NULL
+		};
+		struct arena_t arena = { NULL };
+		const char *path = NULL;
+		char *pkgbuild;
+		size_t len;
+
+		pthread_mutex_lock(&pkgbuilds.lock);
+		if(pkgbuilds.next) {
+			path = pkgbuilds.next->data;
+			pkgbuilds.next = pkgbuilds.next->next;
+		}
+		pthread_mutex_unlock(&pkgbuilds.lock);
+
+		if(!path) {
+			break;
+		}
+
+		pkgbuild = get_file_as_map(path, &len);
+		pkgbuild_scan(pkgbuild, pkg_details, &arena);
+
+		for(i = depends; i; i = alpm_list_next(i)) {
+			char *sanitized = strdup(i->data);
+
+			if(!sanitized) {
+				ALLOC_FAIL(strlen(i->data) + 1);
+				continue;
+			}
+			sanitized[strcspn(sanitized, "<>=")] = '\0';
+			fresh = alpm_list_add(fresh, sanitized);
+		}
+		alpm_list_free(depends);
+		arena_free(&arena);
+
+		if(len) {
+			munmap(pkgbuild, len);
+		} else {
+			free(pkgbuild);
+		}
+
+		pthread_mutex_lock(&pkgbuilds.lock);
+		pkgbuilds.ready = alpm_list_join(pkgbuilds.ready, fresh);
+		if(--pkgbuilds.remaining == 0) {
+			pkgbuilds.finished = stats_now();
+		}
+		pthread_mutex_unlock(&pkgbuilds.lock);
+
+		/* a full pipe already has a wakeup in it */
+		if(pkgbuilds.donefd[1] >= 0 && write(pkgbuilds.donefd[1], "", 1) < 0 &&
+				errno != EAGAIN) {
+			cwr_fprintf(stderr, LOG_ERROR, "failed to wake transfer loop: %s\n",
+					strerror(errno));
+		}
+	}
+
+	return NULL;
+} /* }}} */
+
+int print_escaped(const char *delim) /* {{{ */
+{
+	const char *f;
+	int out = 0;
+
+	for(f = delim; *f != '\0'; f++) {
+		if(*f == '\\') {
+			char c;
+
+			if(!*++f) {
+				break;
+			}
+			c = unescape_char(*f);
+			if(c) {
+				outbuf_putc(c);
+			}
+		} else {
+			outbuf_putc(*f);
+			++out;
+		}
+	}
+
+	return(out);
+} /* }}} */
+
+void print_extinfo_list(alpm_list_t *list, const char *fieldname, const char *delim, int wrap) /* {{{ */
+{
+	const alpm_list_t *next, *i;
+	size_t cols, count = 0;
+
+	if(!list) {
+		return;
+	}
+
+	cols = wrap ? getcols() : 0;
+
+	if(fieldname) {
+		count += outbuf_printf("%-*s: ", INFO_INDENT - 2, fieldname);
+	}
+
+	for(i = list; i; i = next) {
+		size_t data_len = strlen(i->data);
+		next = alpm_list_next(i);
+		if(wrap && cols > 0 && count + data_len >= cols) {
+			outbuf_putc('\n');
+			outbuf_pad(INFO_INDENT);
+			count = INFO_INDENT;
+		}
+		count += data_len;
+		outbuf_puts(i->data);
+		if(next) {
+			count += print_escaped(delim);
+		}
+	}
+	outbuf_putc('\n');
+} /* }}} */
+
+void print_pkg_formatted(struct aurpkg_t *pkg) /* {{{ */
+{
+	const struct fmtop_t *op, *end = fmtprog.ops + fmtprog.count;
+	char buf[256];
+
+	for(op = fmtprog.ops; op < end; op++) {
+		const char *str = buf;
+		int pad;
+
+		switch(op->conv) {
+			case '\0':
+				outbuf_write(op->literal, op->literalsz);
+				continue;
+			/* simple attributes */
+			case 'a':
+				snprintf(buf, sizeof(buf), "%ld", pkg->lastmod);
+				break;
+			case 'c':
+				str = aur_cat[pkg->cat];
+				break;
+			case 'd':
+				str = pkg->desc;
+				break;
+			case 'i':
+				snprintf(buf, sizeof(buf), "%d", pkg->id);
+				break;
+			case 'l':
+				str = pkg->lic;
+				break;
+			case 'm':
+				str = pkg->maint ? pkg->maint : "(orphan)";
+				break;
+			case 'n':
+				str = pkg->name;
+				break;
+			case 'o':
+				snprintf(buf, sizeof(buf), "%d", pkg->votes);
+				break;
+			case 'p':
+				snprintf(buf, sizeof(buf), AUR_PKG_URL_FORMAT, cfg.aururl, pkg->name);
+				break;
+			case 's':
+				snprintf(buf, sizeof(buf), "%ld", pkg->firstsub);
+				break;
+			case 't':
+				str = pkg->ood ? "yes" : "no";
+				break;
+			case 'u':
+				str = pkg->url;
+				break;
+			case 'v':
+				str = pkg->ver;
+				break;
+			/* list based attributes */
+			case 'C':
+				print_extinfo_list(pkg->conflicts, NULL, cfg.delim, 0);
+				continue;
+			case 'D':
+				print_extinfo_list(pkg->depends, NULL, cfg.delim, 0);
+				continue;
+			case 'M':
+				print_extinfo_list(pkg->makedepends, NULL, cfg.delim, 0);
+				continue;
+			case 'O':
+				print_extinfo_list(pkg->optdepends, NULL, cfg.delim, 0);
+				continue;
+			case 'P':
+				print_extinfo_list(pkg->provides, NULL, cfg.delim, 0);
+				continue;
+			case 'R':
+				print_extinfo_list(pkg->replaces, NULL, cfg.delim, 0);
+				continue;
+		}
+
+		if(!str) {
+			str = "";
+		}
+
+		pad = op->width - (int)strlen(str);
+		if(!op->ljust) {
+			outbuf_pad(pad);
+		}
+		outbuf_puts(str);
+		if(op->ljust) {
+			outbuf_pad(pad);
+		}
+	}
+
+	outbuf_putc('\n');
+} /* }}} */
+
+void print_pkg_info(struct aurpkg_t *pkg) /* {{{ */
+{
+	char datestring[42];
+	struct tm *ts;
+	alpm_pkg_t *ipkg;
+
+	outbuf_printf(PKG_REPO "     : %saur%s\n", colstr->repo, colstr->nc);
+	outbuf_printf(NAME "           : %s%s%s", colstr->pkg, pkg->name, colstr->nc);
+	if((ipkg = alpm_db_get_pkg(db_local, pkg->name))) {
+		const char *instcolor;
+		if(alpm_pkg_vercmp(pkg->ver, alpm_pkg_get_version(ipkg)) > 0) {
+			instcolor = colstr->ood;
+		} else {
+			instcolor = colstr->utd;
+		}
+		outbuf_printf(" %s[%sinstalled%s]%s", colstr->url, instcolor, colstr->url, colstr->nc);
+	}
+	outbuf_putc('\n');
+
+	outbuf_printf(VERSION "        : %s%s%s\n",
+			pkg->ood ? colstr->ood : colstr->utd, pkg->ver, colstr->nc);
+	outbuf_printf(URL "            : %s%s%s\n", colstr->url, pkg->url, colstr->nc);
+	outbuf_printf(PKG_AURPAGE "       : %s" AUR_PKG_URL_FORMAT "%s\n",
+			colstr->url, cfg.aururl, pkg->name, colstr->nc);
+
+	print_extinfo_list(pkg->depends, PKG_DEPENDS, LIST_DELIM, 1);
+	print_extinfo_list(pkg->makedepends, PKG_MAKEDEPENDS, LIST_DELIM, 1);
+	print_extinfo_list(pkg->provides, PKG_PROVIDES, LIST_DELIM, 1);
+	print_extinfo_list(pkg->conflicts, PKG_CONFLICTS, LIST_DELIM, 1);
+
+	if(pkg->optdepends) {
+		const alpm_list_t *i;
+		outbuf_printf(PKG_OPTDEPENDS "  : %s\n", (const char*)pkg->optdepends->data);
+		for(i = pkg->optdepends->next; i; i = alpm_list_next(i)) {
+			outbuf_printf("%-*s%s\n", INFO_INDENT, "", (const char*)i->data);
+		}
+	}
+
+	print_extinfo_list(pkg->replaces, PKG_REPLACES, LIST_DELIM, 1);
+
+	outbuf_printf(PKG_CAT "       : %s\n"
+								PKG_LICENSE "        : %s\n"
+								PKG_NUMVOTES "          : %d\n"
+								PKG_OOD "    : %s%s%s\n",
+								aur_cat[pkg->cat], pkg->lic, pkg->votes,
+								pkg->ood ? colstr->ood : colstr->utd,
+								pkg->ood ? "Yes" : "No", colstr->nc);
+
+	outbuf_printf(PKG_MAINT "     : %s\n", pkg->maint ? pkg->maint : "(orphan)");
+
+	ts = localtime(&pkg->firstsub);
+	strftime(datestring, 42, PKG_TIMEFMT, ts);
+	outbuf_printf(PKG_FIRSTSUB "      : %s\n", datestring);
+
+	ts = localtime(&pkg->lastmod);
+	strftime(datestring, 42, PKG_TIMEFMT, ts);
+	outbuf_printf(PKG_LASTMOD "  : %s\n", datestring);
+
+	outbuf_printf(PKG_DESC "    : ");
+	indentprint(pkg->desc, INFO_INDENT);
+	outbuf_printf("\n\n");
+} /* }}} */
+
+void print_pkg_json(struct aurpkg_t *pkg) /* {{{ */
+{
+	const unsigned char *buf;
+	alpm_pkg_t *ipkg;
+	size_t len;
+
+	yajl_gen_map_open(jsongen);
+	jsongen_integer(AUR_ID, pkg->id);
+	jsongen_string(NAME, pkg->name);
+	jsongen_string(VERSION, pkg->ver);
+	jsongen_integer(AUR_CAT, pkg->cat);
+	jsongen_string(AUR_DESC, pkg->desc);
+	jsongen_string(URL, pkg->url);
+	jsongen_string(URLPATH, pkg->urlpath);
+	jsongen_string(AUR_LICENSE, pkg->lic);
+	jsongen_integer(AUR_VOTES, pkg->votes);
+	yajl_gen_string(jsongen, (const unsigned char*)AUR_OOD, strlen(AUR_OOD));
+	yajl_gen_bool(jsongen, pkg->ood);
+	jsongen_string(PKG_MAINT, pkg->maint);
+	jsongen_integer(AUR_FIRSTSUB, pkg->firstsub);
+	jsongen_integer(AUR_LASTMOD, pkg->lastmod);
+
+	if((ipkg = alpm_db_get_pkg(db_local, pkg->name))) {
+		jsongen_string(JSON_INSTALLED, alpm_pkg_get_version(ipkg));
+	}
+
+	/* these only ever come from the PKGBUILD */
+	if(cfg.extinfo) {
+		jsongen_list(JSON_DEPENDS, pkg->depends);
+		jsongen_list(JSON_MAKEDEPENDS, pkg->makedepends);
+		jsongen_list(JSON_OPTDEPENDS, pkg->optdepends);
+		jsongen_list(JSON_PROVIDES, pkg->provides);
+		jsongen_list(JSON_CONFLICTS, pkg->conflicts);
+		jsongen_list(JSON_REPLACES, pkg->replaces);
+	}
+	yajl_gen_map_close(jsongen);
+
+	yajl_gen_get_buf(jsongen, &buf, &len);
+	outbuf_write((const char*)buf, len);
+	outbuf_putc(cfg.jsondelim);
+
+	/* ready the generator for the next record */
+	yajl_gen_clear(jsongen);
+	yajl_gen_reset(jsongen, NULL);
+} /* }}} */
+
+void print_pkg_search(struct aurpkg_t *pkg) /* {{{ */
+{
+	if(cfg.quiet) {
+		outbuf_printf("%s%s%s\n", colstr->pkg, pkg->name, colstr->nc);
+	} else {
+		alpm_pkg_t *ipkg;
+		outbuf_printf("%saur/%s%s%s %s%s%s%s (%d)", colstr->repo, colstr->nc, colstr->pkg,
+				pkg->name, pkg->ood ? colstr->ood : colstr->utd, pkg->ver,
+				NCFLAG(pkg->ood, " <!>"), colstr->nc, pkg->votes);
+		if((ipkg = alpm_db_get_pkg(db_local, pkg->name))) {
+			const char *instcolor;
+			if(alpm_pkg_vercmp(pkg->ver, alpm_pkg_get_version(ipkg)) > 0) {
+				instcolor = colstr->ood;
+			} else {
+				instcolor = colstr->utd;
+			}
+			outbuf_printf(" %s[%sinstalled%s]%s", colstr->url, instcolor, colstr->url, colstr->nc);
+		}
+		outbuf_printf("\n    ");
+		indentprint(pkg->desc, SRCH_INDENT);
+		outbuf_putc('\n');
+	}
+} /* }}} */
+
+void print_results(alpm_list_t *results, void (*printfn)(struct aurpkg_t*)) /* {{{ */
+{
+	const alpm_list_t *i;
+
+	if(!printfn) {
+		return;
+	}
+
+	if(!results && !streaming.drained && (cfg.opmask & OP_INFO)) {
+		cwr_fprintf(stderr, LOG_ERROR, "no results found\n");
+		return;
+	}
+
+	/* already printed as they arrived */
+	if(streaming.printfn) {
+		return;
+	}
+
+	for(i = results; i; i = alpm_list_next(i)) {
+		printfn(i->data);
+
+		if(outbuf.size >= OUTBUF_FLUSH) {
+			outbuf_flush();
+		}
+	}
+	outbuf_flush();
+} /* }}} */
+
+int read_targets_from_file(FILE *in, alpm_list_t **targets, struct strset_t *set) /* {{{ */
+{
+	char block[FEED_BLOCKSIZE];
+	struct response_t carry = { NULL, 0, 0 };
+	size_t len;
+
+	do {
+		len = fread(block, 1, sizeof(block), in);
+		targets_parse(&carry, block, len, targets, set);
+	} while(len > 0);
+	free(carry.data);
+
+	if(ferror(in)) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to read targets: %s\n", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+} /* }}} */
+
+void request_free(void) /* {{{ */
+{
+	/* workers may still be running if the loop bailed out early */
+	pkgbuilds_free();
+
+	alpm_list_free_inner(results, aurpkg_free);
+	alpm_list_free(results);
+	results = NULL;
+	workq = NULL;
+
+	FREE(cfg.aururl);
+	FREE(cfg.dlpath);
+	FREE(cfg.cachedir);
+	FREELIST(cfg.targets);
+	strset_free(&targetset);
+	strset_free(&cfg.ignore.pkgs);
+	filter_free();
+	format_free();
+	snapshot_free();
+	FREE(outbuf.data);
+	outbuf.size = outbuf.capacity = 0;
+	if(jsongen) {
+		yajl_gen_free(jsongen);
+		jsongen = NULL;
+	}
+	memset(&streaming, 0, sizeof(streaming));
+	feed_free();
+	FREELIST(cfg.ignore.repos);
+	FREE(colstr);
+	termcols = -1;
+
+	/* nothing to report for a request that was forwarded to the daemon or
+	 * declined by it. stats.start is only set by request_run */
+	if(cfg.stats && stats.start > 0) {
+		stats_report();
+	}
+	stats_free();
+	memset(&stats, 0, sizeof(stats));
+} /* }}} */
+
+int request_run(void) /* {{{ */
+{
+	const alpm_list_t *i;
+	double t0;
+	int ret;
+	struct task_t task = {
+		.printfn = NULL,
+		.taskfn = task_query
+	};
+
+	stats.start = stats_now();
+
+	/* fallback from sentinel values */
+	/* without --threads the window starts at the old default and is free to
+	 * find its own level. an explicit limit is honored as given. */
+	if(cfg.maxthreads == UNSET) {
+		cfg.maxthreads = THREAD_MAX;
+		transfers.window = THREAD_DEFAULT;
+	} else {
+		transfers.window = cfg.maxthreads;
+	}
+	cfg.timeout = cfg.timeout == UNSET ? TIMEOUT_DEFAULT : cfg.timeout;
+	cfg.color = cfg.color == UNSET ? 0 : cfg.color;
+	cfg.ignoreood = cfg.ignoreood == UNSET ? 0 : cfg.ignoreood;
+	if(!cfg.aururl) {
+		cfg.aururl = strdup(AUR_URL_DEFAULT);
+	}
+	/* every path gets appended with a leading slash of its own */
+	while(*cfg.aururl && cfg.aururl[strlen(cfg.aururl) - 1] == '/') {
+		cfg.aururl[strlen(cfg.aururl) - 1] = '\0';
+	}
+
+	if((ret = strings_init()) != 0) {
+		return ret;
+	}
+
+	if(cfg.format && format_compile(cfg.format) != 0) {
+		ret = 1;
+		goto finish;
+	}
+
+	if((ret = set_working_dir()) != 0) {
+		goto finish;
+	}
+
+	/* not fatal. we'll just go without a cache */
+	if(cache_init() != 0) {
+		cfg.cachettl = UNSET;
+	}
+
+	if(cfg.frompkgbuild) {
+		/* treat arguments as filenames to load/extract. the parsing overlaps
+		 * with alpm and curl's startup, and after that with the transfers */
+		strset_free(&targetset);
+		pkgbuilds_start(cfg.targets);
+		cfg.targets = NULL;
+
+		/* same as stdin: only the transfer loop can take targets as they
+		 * come. everything else waits for the whole list */
+		if((cfg.opmask & (OP_UPDATE|OP_SYNC)) || cfg.offline) {
+			pkgbuilds_join();
+			pkgbuilds_collect();
+		}
+	} else if(strset_contains(&targetset, "-")) {
+		char *vdata;
+		cfg.targets = alpm_list_remove_str(cfg.targets, "-", &vdata);
+		free(vdata);
+		cwr_printf(LOG_DEBUG, "reading targets from stdin\n");
+
+		/* updates are checked against the snapshot all at once, offline
+		 * searches never enter the transfer loop, and a search has to match
+		 * every term, so the filter needs all of them before the first
+		 * response. everything else starts on the first targets while the
+		 * rest are still coming in. */
+		if(!(cfg.opmask & (OP_UPDATE|OP_SYNC|OP_SEARCH)) && !cfg.offline) {
+			feed.active = 1;
+		} else {
+			ret = read_targets_from_file(stdin, &cfg.targets, &targetset);
+			if(ret != 0) {
+				goto finish;
+			}
+			/* a daemon gets a fresh stdin with every request */
+			if(!server.serving && !freopen(ctermid(NULL), "r", stdin)) {
+				cwr_printf(LOG_DEBUG, "failed to reopen stdin for reading\n");
+			}
+		}
+	}
+
+	/* a daemon has all of this ready before the first request comes in */
+	if(!pmhandle) {
+		t0 = stats_now();
+		pmhandle = alpm_init();
+		stats_add(PHASE_ALPM, t0);
+		if(!pmhandle) {
+			cwr_fprintf(stderr, LOG_ERROR, "failed to initialize alpm library\n");
+			goto finish;
+		}
+	}
+
+	if((cfg.opmask & OP_UPDATE) && !cfg.targets) {
+		syncindex_start();
+	}
+
+	if(!transfers.multi) {
+		cwr_printf(LOG_DEBUG, "initializing curl\n");
+		ret = curl_global_init(CURL_GLOBAL_ALL);
+		if(ret != 0) {
+			cwr_fprintf(stderr, LOG_ERROR, "failed to initialize curl\n");
+			goto finish;
+		}
+
+		if(transfer_init() != 0) {
+			cwr_fprintf(stderr, LOG_ERROR, "failed to initialize curl\n");
+			ret = 1;
+			goto finish;
+		}
+	}
+
+	if(cfg.opmask & OP_SYNC) {
+		ret = index_sync();
+		goto finish;
+	}
+
+	/* allow specific updates to be provided instead of examining all foreign pkgs */
+	if((cfg.opmask & OP_UPDATE) && !cfg.targets) {
+		cfg.targets = alpm_find_foreign_pkgs();
+		for(i = cfg.targets; i; i = alpm_list_next(i)) {
+			strset_add(&targetset, i->data);
+		}
+	}
+
+	workq = cfg.targets;
+	if(!workq && !feed.active && !pkgbuilds.active) {
+		fprintf(stderr, "error: no targets specified (use -h for help)\n");
+		goto finish;
+	}
+
+	if((cfg.opmask & OP_UPDATE) && cfg.cachedir) {
+		snapshot_load();
+		workq = snapshot_replay();
+	}
+
+	/* override task behavior */
+	if(cfg.opmask & OP_UPDATE) {
+		task.taskfn = task_update;
+		task.batched = 1;
+	} else if(cfg.opmask & OP_INFO) {
+		task.taskfn = task_multiinfo;
+		task.printfn = cfg.format ? print_pkg_formatted : print_pkg_info;
+		task.batched = 1;
+	} else if(cfg.opmask & (OP_SEARCH|OP_MSEARCH)) {
+		task.printfn = cfg.format ? print_pkg_formatted : print_pkg_search;
+	} else if(cfg.opmask & OP_DOWNLOAD) {
+		task.taskfn = task_download;
+	}
+
+	if(cfg.json && !(cfg.opmask & OP_DOWNLOAD)) {
+		/* skip all of the human readable output, colors and all */
+		jsongen = yajl_gen_alloc(NULL);
+		if(!jsongen) {
+			cwr_fprintf(stderr, LOG_ERROR, "failed to initialize json generator\n");
+			ret = 1;
+			goto finish;
+		}
+		task.printfn = print_pkg_json;
+	}
+
+	/* only lookups stream. updates print what task_update_cb keeps,
+	 * snapshot replays included, once everything is in */
+	if(cfg.stream && (cfg.opmask & (OP_INFO|OP_SEARCH|OP_MSEARCH)) &&
+			!(cfg.opmask & OP_UPDATE)) {
+		streaming.printfn = task.printfn;
+
+		/* more info still needs the packages once printed */
+		streaming.drain = !cfg.extinfo;
+	}
+
+	if(filter_init() != 0) {
+		ret = 1;
+		goto finish;
+	}
+
+	if(cfg.offline && (cfg.opmask & (OP_SEARCH|OP_MSEARCH))) {
+		ret = index_search();
+	} else {
+		ret = transfer_loop(&task);
+	}
+	if(ret != 0) {
+		goto finish;
+	}
+
+	if(cfg.opmask & OP_UPDATE) {
+		snapshot_save();
+	}
+
+	/* we need to exit with a non-zero value when:
+	 * a) search/info/download returns nothing
+	 * b) update (without download) returns something
+	 * this is opposing behavior, so just XOR the result on a pure update */
+	if(!streaming.printfn) {
+		results = sort_results(results);
+	}
+	ret = ((results == NULL && !streaming.drained) ^ !(cfg.opmask & ~OP_UPDATE));
+	t0 = stats_now();
+	print_results(results, task.printfn);
+	stats_add(PHASE_OUTPUT, t0);
+
+finish:
+	return ret;
+} /* }}} */
+
+int resolve_dependencies(const char *pkgname, const char *subdir) /* {{{ */
+{
+	const alpm_list_t *i;
+	alpm_list_t *deplist = NULL;
+	struct arena_t arena = { NULL };
+	char *filename, *pkgbuild;
+
+	cwr_asprintf(&filename, "%s/%s/PKGBUILD", cfg.dlpath, subdir ? subdir : pkgname);
+
+	pkgbuild = get_file_as_buffer(filename);
+	if(!pkgbuild) {
+		return 1;
+	}
+
+	alpm_list_t **pkg_details[PKGDETAIL_MAX] = {
+		&deplist, &deplist, NULL, NULL, NULL, NULL
+	};
+
+	cwr_printf(LOG_DEBUG, "Parsing %s for extended info\n", filename);
+	pkgbuild_get_extinfo(pkgbuild, pkg_details, &arena);
+	free(pkgbuild);
+	free(filename);
+
+	for(i = deplist; i; i = alpm_list_next(i)) {
+		const char *depend = i->data;
+		char *sanitized = strdup(depend);
+
+		sanitized[strcspn(sanitized, "<>=")] = '\0';
+
+		if(strset_add(&targetset, sanitized) == 0) {
+			if(cfg.logmask & LOG_BRIEF &&
+							!alpm_find_satisfier(alpm_db_get_pkgcache(db_local), depend)) {
+					cwr_printf(LOG_BRIEF, "S\t%s\n", sanitized);
+			}
+			FREE(sanitized);
+			continue;
+		}
+
+		if(alpm_find_satisfier(alpm_db_get_pkgcache(db_local), depend)) {
+			cwr_printf(LOG_DEBUG, "%s is already satisified\n", depend);
+			FREE(sanitized);
+		} else if(pkg_is_binary(depend)) {
+			FREE(sanitized);
+		} else {
+			/* the transfer loop picks this up as soon as a connection frees up,
+			 * so the tree is fetched breadth first */
+			workq_push(sanitized);
+		}
+	}
+
+	alpm_list_free(deplist);
+	arena_free(&arena);
+
+	return 0;
+} /* }}} */
+
+void response_release(struct response_t *mem) /* {{{ */
+{
+	if(!mem->data) {
+		return;
+	}
+
+	/* don't let one oversized body pin its memory for the rest of the run */
+	if(bufpool.count < BUFPOOL_MAX && mem->capacity <= BUFPOOL_MAXSIZE) {
+		mem->size = 0;
+		bufpool.bufs[bufpool.count++] = *mem;
+	} else {
+		free(mem->data);
+	}
+
+	mem->data = NULL;
+	mem->size = mem->capacity = 0;
+} /* }}} */
+
+int response_reserve(struct response_t *mem, size_t size) /* {{{ */
+{
+	char *newdata;
+	size_t newcap;
+
+	if(!mem->data && bufpool.count > 0) {
+		*mem = bufpool.bufs[--bufpool.count];
+	}
+
+	if(size <= mem->capacity) {
+		return 0;
+	}
+
+	newcap = mem->capacity ? mem->capacity : BUFSIZE_MIN;
+	while(newcap < size) {
+		newcap *= 2;
+	}
+
+	newdata = realloc(mem->data, newcap);
+	if(!newdata) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to reallocate %zd bytes\n", newcap);
+		return 1;
+	}
+
+	mem->data = newdata;
+	mem->capacity = newcap;
+
+	return 0;
+} /* }}} */
+
+int server_compatible(void) /* {{{ */
+{
+	const alpm_list_t *i;
+
+	/* the sync dbs were registered according to the daemon's own config. a
+	 * repo ignored both in the config and on the command line shows up twice,
+	 * so compare these as sets */
+	if(cfg.skiprepos != server.skiprepos) {
+		return 0;
+	}
+
+	for(i = cfg.ignore.repos; i; i = alpm_list_next(i)) {
+		if(!alpm_list_find_str(server.repos, i->data)) {
+			return 0;
+		}
+	}
+	for(i = server.repos; i; i = alpm_list_next(i)) {
+		if(!alpm_list_find_str(cfg.ignore.repos, i->data)) {
+			return 0;
+		}
+	}
+
+	return 1;
+} /* }}} */
+
+int server_forward(int argc, char *argv[]) /* {{{ */
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	char control[CMSG_SPACE(sizeof(fds))], cwd[PATH_MAX], *payload, *p;
+	uint32_t header[2] = { SERVER_MAGIC, 0 };
+	struct iovec iov = { header, sizeof(header) };
+	struct msghdr msg = { 0 };
+	struct cmsghdr *cmsg;
+	int32_t status;
+	int fd, n;
+
+	if(get_socket_path(addr.sun_path, sizeof(addr.sun_path)) != 0 ||
+			!getcwd(cwd, sizeof(cwd))) {
+		return SERVER_DECLINED;
+	}
+
+	/* not having a daemon around is the usual case, and not worth a word */
+	fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if(fd < 0) {
+		return SERVER_DECLINED;
+	}
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return SERVER_DECLINED;
+	}
+
+	/* the working directory, then the arguments, each NUL terminated */
+	header[1] = strlen(cwd) + 1;
+	for(n = 1; n < argc; n++) {
+		header[1] += strlen(argv[n]) + 1;
+	}
+	/* nothing has been printed yet, so colstr isn't there for ALLOC_FAIL */
+	payload = malloc(header[1]);
+	if(!payload) {
+		close(fd);
+		return SERVER_DECLINED;
+	}
+	p = stpcpy(payload, cwd) + 1;
+	for(n = 1; n < argc; n++) {
+		p = stpcpy(p, argv[n]) + 1;
+	}
+
+	/* the daemon prints straight to our stdout and stderr, and reads our
+	 * stdin, so nothing but the exit status needs to come back */
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	if(sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(header) ||
+			sock_write(fd, payload, header[1]) != 0) {
+		free(payload);
+		close(fd);
+		return SERVER_DECLINED;
+	}
+	free(payload);
+
+	if(sock_read(fd, &status, sizeof(status)) != 0) {
+		fprintf(stderr, "error: lost connection to the cower daemon\n");
+		status = 1;
+	}
+	close(fd);
+
+	return status;
+} /* }}} */
+
+void server_handle(int fd) /* {{{ */
+{
+	uint32_t header[2];
+	int fds[3] = { -1, -1, -1 }, saved[3];
+	char control[CMSG_SPACE(sizeof(fds))], *payload = NULL, *p, **argv = NULL;
+	struct iovec iov = { header, sizeof(header) };
+	struct msghdr msg = { 0 };
+	struct cmsghdr *cmsg;
+	struct ucred cred;
+	socklen_t credlen = sizeof(cred);
+	int32_t status = SERVER_DECLINED;
+	int argc, n;
+
+	/* the socket lives somewhere only we can reach, but make sure */
+	if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credlen) != 0 ||
+			cred.uid != getuid()) {
+		return;
+	}
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if(recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(header)) {
+		goto done;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if(cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	}
+
+	/* anything else came from some other build of cower. the client can
+	 * still do the work itself. */
+	if(fds[0] < 0 || header[0] != SERVER_MAGIC || header[1] == 0 ||
+			header[1] > SERVER_MSG_MAX) {
+		goto done;
+	}
+
+	/* between requests there's nobody to report a failed allocation to */
+	payload = malloc(header[1]);
+	if(!payload) {
+		goto done;
+	}
+	if(sock_read(fd, payload, header[1]) != 0 || payload[header[1] - 1] != '\0') {
+		goto done;
+	}
+
+	argc = 1;
+	for(p = payload + strlen(payload) + 1; p < payload + header[1]; p += strlen(p) + 1) {
+		argc++;
+	}
+	argv = calloc(argc + 1, sizeof(char*));
+	if(!argv) {
+		goto done;
+	}
+	argv[0] = program_invocation_name;
+	for(n = 1, p = payload + strlen(payload) + 1; n < argc; p += strlen(p) + 1) {
+		argv[n++] = p;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	for(n = 0; n < 3; n++) {
+		saved[n] = dup(n);
+		dup2(fds[n], n);
+	}
+	clearerr(stdin);
+
+	status = server_request(payload, argc, argv);
+
+	fflush(stdout);
+	fflush(stderr);
+	for(n = 0; n < 3; n++) {
+		dup2(saved[n], n);
+		close(saved[n]);
+	}
+
+done:
+	for(n = 0; n < 3; n++) {
+		if(fds[n] >= 0) {
+			close(fds[n]);
+		}
+	}
+	sock_write(fd, &status, sizeof(status));
+	free(argv);
+	free(payload);
+} /* }}} */
+
+void server_reload(void) /* {{{ */
+{
+	cwr_printf(LOG_DEBUG, "pacman databases changed, reloading alpm\n");
+
+	syncindex_free();
+	alpm_provides_free();
+	alpm_release(pmhandle);
+	pmhandle = NULL;
+	db_local = NULL;
+	strset_free(&pmignore);
+
+	server_warm();
+} /* }}} */
+
+int server_request(const char *cwd, int argc, char *argv[]) /* {{{ */
+{
+	int ret;
+
+	config_init();
+
+	/* start getopt over from scratch */
+	optind = 0;
+
+	if(chdir(cwd) != 0) {
+		fprintf(stderr, "error: failed to chdir to %s: %s\n", cwd, strerror(errno));
+		ret = 1;
+		goto finish;
+	}
+
+	ret = parse_options(argc, argv);
+	switch(ret) {
+		case 0:
+			break;
+		case 3:
+			fprintf(stderr, "error: no operation specified (use -h for help)\n");
+		default:
+			goto finish;
+	}
+
+	if(cfg.opmask & OP_SERVE) {
+		fprintf(stderr, "error: a daemon is already running\n");
+		ret = 1;
+		goto finish;
+	}
+
+	/* the config adds to the command line's ignored repos, and a reload
+	 * registers the sync dbs from what's in cfg by then */
+	if((ret = parse_configfile()) != 0) {
+		goto finish;
+	}
+
+	if(!server_compatible()) {
+		ret = SERVER_DECLINED;
+		goto finish;
+	}
+
+	/* pacman ran since we last looked. what we have is out of date. */
+	if(server_stale()) {
+		server_reload();
+	}
+
+	ret = request_run();
+
+finish:
+	request_free();
+	config_init();
+	cfg.logmask = server.logmask;
+	if(chdir("/") != 0) {
+		cwr_printf(LOG_DEBUG, "failed to chdir to /: %s\n", strerror(errno));
+	}
+
+	return ret;
+} /* }}} */
+
+int server_run(void) /* {{{ */
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct sigaction sa;
+	const alpm_list_t *i;
+	char dir[sizeof(addr.sun_path)];
+	mode_t mask;
+	int fd, ret;
+
+	if((ret = parse_configfile()) != 0 || (ret = strings_init()) != 0) {
+		return ret;
+	}
+
+	if(get_socket_path(addr.sun_path, sizeof(addr.sun_path)) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "unable to determine socket path\n");
+		return 1;
+	}
+	strcpy(dir, addr.sun_path);
+	*strrchr(dir, '/') = '\0';
+	if(mkdir_p(dir) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to create %s: %s\n", dir, strerror(errno));
+		return 1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+	if(fd < 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to create socket: %s\n", strerror(errno));
+		return 1;
+	}
+
+	/* a socket nobody answers on was left behind by a daemon that died */
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "a daemon is already listening on %s\n",
+				addr.sun_path);
+		close(fd);
+		return 1;
+	}
+	unlink(addr.sun_path);
+
+	mask = umask(077);
+	ret = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(mask);
+	if(ret != 0 || listen(fd, SOMAXCONN) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to listen on %s: %s\n", addr.sun_path,
+				strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	server_warm();
+	if(!pmhandle || !transfers.multi) {
+		close(fd);
+		unlink(addr.sun_path);
+		return 1;
+	}
+
+	/* requests are checked against the repos registered here */
+	server.skiprepos = cfg.skiprepos;
+	for(i = cfg.ignore.repos; i; i = alpm_list_next(i)) {
+		server.repos = alpm_list_add(server.repos, strdup(i->data));
+	}
+	server.logmask = cfg.logmask;
+	server.serving = 1;
+
+	/* no SA_RESTART. accept has to give up so the loop can notice. */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = server_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	cwr_printf(LOG_INFO, "listening on %s\n", addr.sun_path);
+	fflush(stdout);
+
+	request_free();
+	config_init();
+	cfg.logmask = server.logmask;
+	if(chdir("/") != 0) {
+		cwr_printf(LOG_DEBUG, "failed to chdir to /: %s\n", strerror(errno));
+	}
+
+	while(!server.quit) {
+		int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if(client < 0) {
+			if(errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			fprintf(stderr, "error: failed to accept connection: %s\n", strerror(errno));
+			ret = 1;
+			break;
+		}
+
+		server_handle(client);
+		close(client);
+	}
+
+	close(fd);
+	unlink(addr.sun_path);
+	FREELIST(server.repos);
+
+	return ret;
+} /* }}} */
+
+void server_signal(int UNUSED signum) /* {{{ */
+{
+	server.quit = 1;
+} /* }}} */
+
+int server_stale(void) /* {{{ */
+{
+	struct stat local, sync;
+	int stale;
+
+	/* pacman adds and removes a directory in local/ for every package it
+	 * touches, and renames new databases into sync/ */
+	if(stat(PACMAN_DBPATH "/local", &local) != 0 || stat(PACMAN_DBPATH "/sync", &sync) != 0) {
+		return 0;
+	}
+
+	stale = local.st_mtim.tv_sec != server.localmtime.tv_sec ||
+		local.st_mtim.tv_nsec != server.localmtime.tv_nsec ||
+		sync.st_mtim.tv_sec != server.syncmtime.tv_sec ||
+		sync.st_mtim.tv_nsec != server.syncmtime.tv_nsec;
+
+	server.localmtime = local.st_mtim;
+	server.syncmtime = sync.st_mtim;
+
+	return stale;
+} /* }}} */
+
+void server_warm(void) /* {{{ */
+{
+	/* taken before loading anything, so that a change made while we load
+	 * still shows up next time */
+	server_stale();
+
+	pmhandle = alpm_init();
+	if(!pmhandle) {
+		fprintf(stderr, "error: failed to initialize alpm library\n");
+		return;
+	}
+
+	syncindex_start();
+
+	if(!transfers.multi) {
+		if(curl_global_init(CURL_GLOBAL_ALL) != 0 || transfer_init() != 0) {
+			fprintf(stderr, "error: failed to initialize curl\n");
+			transfer_cleanup();
+		}
+	}
+
+	syncindex_wait();
+	alpm_provides_init();
+} /* }}} */
+
+int set_working_dir(void) /* {{{ */
+{
+	char *resolved;
+
+	if(!(cfg.opmask & OP_DOWNLOAD)) {
+		FREE(cfg.dlpath);
+		return 0;
+	}
+
+	resolved = cfg.dlpath ? realpath(cfg.dlpath, NULL) : getcwd(NULL, 0);
+	if(!resolved) {
+		fprintf(stderr, "error: failed to resolve download path %s: %s\n",
+				cfg.dlpath, strerror(errno));
+		FREE(cfg.dlpath);
+		return 1;
+	}
+
+	free(cfg.dlpath);
+	cfg.dlpath = resolved;
+
+	if(access(cfg.dlpath, W_OK) != 0) {
+		fprintf(stderr, "error: cannot write to %s: %s\n",
+				cfg.dlpath, strerror(errno));
+		FREE(cfg.dlpath);
+		return 1;
+	}
+
+	if(chdir(cfg.dlpath) != 0) {
+		fprintf(stderr, "error: failed to chdir to %s: %s\n", cfg.dlpath,
+				strerror(errno));
+		return 1;
+	}
+
+	return 0;
+} /* }}} */
+
+void snapshot_free(void) /* {{{ */
+{
+	size_t i;
+
+	for(i = 0; i < snapshot.pkgs.size; i++) {
+		struct snapshot_t *entry = snapshot.pkgs.vals[i];
+
+		if(entry) {
+			free(entry->localver);
+			free(entry->aurver);
+			free(entry);
+		}
+	}
+	strset_free(&snapshot.pkgs);
+} /* }}} */
+
+void snapshot_load(void) /* {{{ */
+{
+	char *path, *buf, *line, *saveptr;
+
+	if(cwr_asprintf(&path, "%s/" SNAPSHOT_FILE, cfg.cachedir) == -1) {
+		return;
+	}
+
+	/* not having checked before isn't an error */
+	buf = access(path, F_OK) == 0 ? get_file_as_buffer(path) : NULL;
+	free(path);
+	if(!buf) {
+		return;
+	}
+
+	if(!STR_STARTS_WITH(buf, SNAPSHOT_HEADER)) {
+		free(buf);
+		return;
+	}
+
+	for(line = strtok_r(buf + strlen(SNAPSHOT_HEADER), "\n", &saveptr); line;
+			line = strtok_r(NULL, "\n", &saveptr)) {
+		struct snapshot_t *entry;
+		char *fields[5];
+		int n;
+
+		for(n = 0; n < 5 && line; n++) {
+			fields[n] = line;
+			line = strchr(line, '\t');
+			if(line) {
+				*line++ = '\0';
+			}
+		}
+		if(n != 5 || line) {
+			continue;
+		}
+
+		MALLOC(entry, sizeof(struct snapshot_t), break);
+		entry->localver = strdup(fields[1]);
+		entry->aurver = strdup(fields[2]);
+		entry->lastmod = (time_t)strtoll(fields[3], NULL, 10);
+		entry->checked = (time_t)strtoll(fields[4], NULL, 10);
+		if(strset_put(&snapshot.pkgs, fields[0], entry) != 0) {
+			free(entry->localver);
+			free(entry->aurver);
+			free(entry);
+		}
+	}
+
+	free(buf);
+} /* }}} */
+
+void snapshot_record(const alpm_list_t *pkglist) /* {{{ */
+{
+	const alpm_list_t *i;
+	time_t now = time(NULL);
+
+	if(!cfg.cachedir) {
+		return;
+	}
+
+	for(i = pkglist; i; i = alpm_list_next(i)) {
+		const struct aurpkg_t *aurpkg = i->data;
+		struct snapshot_t *entry;
+		alpm_pkg_t *pmpkg;
+
+		pmpkg = alpm_db_get_pkg(db_local, aurpkg->name);
+		if(!pmpkg || !aurpkg->ver) {
+			continue;
+		}
+
+		entry = strset_get(&snapshot.pkgs, aurpkg->name);
+		if(entry) {
+			free(entry->localver);
+			free(entry->aurver);
+		} else {
+			MALLOC(entry, sizeof(struct snapshot_t), return);
+			if(strset_put(&snapshot.pkgs, aurpkg->name, entry) != 0) {
+				free(entry);
+				return;
+			}
+		}
+
+		entry->localver = strdup(alpm_pkg_get_version(pmpkg));
+		entry->aurver = strdup(aurpkg->ver);
+		entry->lastmod = aurpkg->lastmod;
+		entry->checked = now;
+		snapshot.dirty = 1;
+	}
+} /* }}} */
+
+alpm_list_t *snapshot_replay(void) /* {{{ */
+{
+	alpm_list_t *i, *next, *fresh = NULL, *stale = NULL, *pkgs = NULL;
+	struct arena_t *arena;
+	time_t now = time(NULL);
+
+	if(cfg.cachettl <= 0 || snapshot.pkgs.count == 0) {
+		return cfg.targets;
+	}
+
+	arena = arena_new();
+	if(!arena) {
+		return cfg.targets;
+	}
+
+	/* a package is only worth asking the AUR about again if it was reinstalled
+	 * at another version, or if what we know about it has gone stale */
+	for(i = cfg.targets; i; i = next) {
+		const char *name = i->data;
+		struct snapshot_t *entry = strset_get(&snapshot.pkgs, name);
+		alpm_pkg_t *pmpkg = alpm_db_get_pkg(db_local, name);
+
+		next = alpm_list_next(i);
+
+		if(entry && pmpkg && now - entry->checked < cfg.cachettl &&
+				STREQ(entry->localver, alpm_pkg_get_version(pmpkg))) {
+			struct aurpkg_t scratch, *pkg;
+
+			memset(&scratch, 0, sizeof(struct aurpkg_t));
+			scratch.arena = arena;
+			scratch.name = arena_strdup(arena, name);
+			scratch.ver = arena_strdup(arena, entry->aurver);
+			scratch.lastmod = entry->lastmod;
+
+			pkg = scratch.name && scratch.ver ? aurpkg_dup(&scratch) : NULL;
+			if(pkg) {
+				pkgs = alpm_list_add(pkgs, pkg);
+				fresh = alpm_list_add(fresh, i->data);
+				continue;
+			}
+		}
+
+		stale = alpm_list_add(stale, i->data);
+	}
+	arena_release(arena);
+
+	cwr_printf(LOG_DEBUG, "%zd of %zd packages unchanged since the last check\n",
+			alpm_list_count(fresh), alpm_list_count(cfg.targets));
+
+	/* the fresh targets go up front, so the work queue only sees stale ones */
+	alpm_list_free(cfg.targets);
+	cfg.targets = alpm_list_join(fresh, stale);
+
+	task_update_cb(pkgs, &snapshot);
+
+	return stale;
+} /* }}} */
+
+void snapshot_save(void) /* {{{ */
+{
+	char *path, *tmpfile;
+	size_t i;
+	FILE *fp;
+	int fd;
+
+	if(!cfg.cachedir || !snapshot.dirty) {
+		return;
+	}
+
+	if(cwr_asprintf(&path, "%s/" SNAPSHOT_FILE, cfg.cachedir) == -1) {
+		return;
+	}
+	if(cwr_asprintf(&tmpfile, "%s.XXXXXX", path) == -1) {
+		free(path);
+		return;
+	}
+
+	fd = mkstemp(tmpfile);
+	if(fd < 0 || !(fp = fdopen(fd, "w"))) {
+		cwr_printf(LOG_DEBUG, "failed to open %s: %s\n", tmpfile, strerror(errno));
+		if(fd >= 0) {
+			close(fd);
+			unlink(tmpfile);
+		}
+		goto finish;
+	}
+
+	fputs(SNAPSHOT_HEADER, fp);
+	for(i = 0; i < snapshot.pkgs.size; i++) {
+		const struct snapshot_t *entry = snapshot.pkgs.vals[i];
+		const char *name = snapshot.pkgs.keys[i];
+
+		/* forget about packages that have since been removed */
+		if(!entry || !alpm_db_get_pkg(db_local, name)) {
+			continue;
+		}
+
+		fprintf(fp, "%s\t%s\t%s\t%lld\t%lld\n", name, entry->localver, entry->aurver,
+				(long long)entry->lastmod, (long long)entry->checked);
+	}
+
+	if(fclose(fp) != 0 || rename(tmpfile, path) != 0) {
+		cwr_printf(LOG_DEBUG, "failed to write %s: %s\n", path, strerror(errno));
+		unlink(tmpfile);
+	}
+
+finish:
+	free(tmpfile);
+	free(path);
+} /* }}} */
+
+int sock_read(int fd, void *buf, size_t len) /* {{{ */
+{
+	char *p = buf;
+
+	while(len > 0) {
+		ssize_t n = read(fd, p, len);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return 1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+} /* }}} */
+
+int sock_write(int fd, const void *buf, size_t len) /* {{{ */
+{
+	const char *p = buf;
+
+	while(len > 0) {
+		ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR) {
+			continue;
+		}
+		if(n <= 0) {
+			return 1;
+		}
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+} /* }}} */
+
+alpm_list_t *sort_results(alpm_list_t *list) /* {{{ */
+{
+	struct aurpkg_t **pkgs;
+	alpm_list_t *i, *last = NULL;
+	size_t count, n, unique;
+
+	count = alpm_list_count(list);
+	if(count < 2) {
+		return list;
+	}
+
+	MALLOC(pkgs, count * sizeof(struct aurpkg_t*), return list);
+	for(i = list, n = 0; i; i = alpm_list_next(i)) {
+		pkgs[n++] = i->data;
+	}
+
+	qsort(pkgs, count, sizeof(struct aurpkg_t*), aurpkg_ptrcmp);
+
+	/* overlapping search terms bring back the same package more than once.
+	 * after sorting, the copies are adjacent */
+	for(n = 1, unique = 1; n < count; n++) {
+		if(aurpkg_cmp(pkgs[n], pkgs[unique - 1]) == 0) {
+			aurpkg_free(pkgs[n]);
+		} else {
+			pkgs[unique++] = pkgs[n];
+		}
+	}
+
+	/* reuse the existing nodes and drop whatever is left over */
+	for(i = list, n = 0; n < unique; i = i->next) {
+		i->data = pkgs[n++];
+		last = i;
+	}
+	if(i) {
+		last->next = NULL;
+		list->prev = last;
+		alpm_list_free(i);
+	}
+	free(pkgs);
+
+	return list;
+} /* }}} */
+
+void stats_add(phase_t phase, double since) /* {{{ */
+{
+	if(cfg.stats) {
+		stats.phase[phase] += stats_now() - since;
+	}
+} /* }}} */
+
+void stats_extract(int begin) /* {{{ */
+{
+	/* several tarballs can be extracting at once. the phase is the time at
+	 * least one of them was, not each thread's time added up */
+	if(!cfg.stats) {
+		return;
+	}
+
+	if(begin) {
+		if(stats.extracting++ == 0) {
+			stats.extractsince = stats_now();
+		}
+	} else if(stats.extracting > 0 && --stats.extracting == 0) {
+		stats.phase[PHASE_EXTRACT] += stats_now() - stats.extractsince;
+	}
+} /* }}} */
+
+void stats_free(void) /* {{{ */
+{
+	alpm_list_t *i;
+
+	for(i = stats.requests; i; i = alpm_list_next(i)) {
+		struct reqstat_t *req = i->data;
+		free(req->label);
+		free(req);
+	}
+	alpm_list_free(stats.requests);
+	stats.requests = NULL;
+} /* }}} */
+
+void stats_network(double since, double json) /* {{{ */
+{
+	double elapsed;
+
+	if(!cfg.stats) {
+		return;
+	}
+
+	/* responses are parsed from inside curl's write callbacks. that time is
+	 * already counted against parsing */
+	elapsed = stats_now() - since - (stats.phase[PHASE_JSON] - json);
+	stats.phase[PHASE_NETWORK] += elapsed;
+	stats.busy += transfers.inflight * elapsed;
+} /* }}} */
+
+double stats_now(void) /* {{{ */
+{
+	if(!cfg.stats) {
+		return 0;
+	}
+
+	return clock_now();
+} /* }}} */
+
+void stats_report(void) /* {{{ */
+{
+	static const char *phases[PHASE_MAX] = {
+		"alpm init", "pkgcache load", "queueing", "network", "json parse",
+		"pkgbuild parse", "extraction", "output"
+	};
+	const alpm_list_t *i;
+	double wall = stats_now() - stats.start;
+	size_t nreqs = alpm_list_count(stats.requests);
+	int n;
+
+	if(cfg.stats == STATS_JSON) {
+		stats_report_json();
+		return;
+	}
+
+	fprintf(stderr, "\n%-16s %9.3fs\n", "wall time", wall);
+	for(n = 0; n < PHASE_MAX; n++) {
+		fprintf(stderr, "  %-14s %9.3fs\n", phases[n], stats.phase[n]);
+	}
+
+	fprintf(stderr, "\n%zd requests, %.0f bytes, %.3fs spent queued\n", nreqs,
+			stats.bytes, stats.queuewait);
+	fprintf(stderr, "connections: %d of %d at peak, %.1f in use on average\n",
+			stats.peak, cfg.maxthreads,
+			stats.phase[PHASE_NETWORK] > 0 ? stats.busy / stats.phase[PHASE_NETWORK] : 0);
+	fprintf(stderr, "tls: %d handshakes, %d requests on reused connections, "
+			"%ld share locks (uncontended, single threaded)\n", stats.handshakes,
+			stats.reused, stats.sharelocks);
+
+	if(!nreqs) {
+		return;
+	}
+
+	/* the curl timings are cumulative from the start of each request */
+	fprintf(stderr, "\n%8s %8s %8s %8s %8s %8s %10s %4s  %s\n", "queued", "dns",
+			"connect", "tls", "ttfb", "total", "bytes", "http", "request");
+	for(i = stats.requests; i; i = alpm_list_next(i)) {
+		const struct reqstat_t *req = i->data;
+
+		fprintf(stderr, "%8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %10.0f %4ld  %s\n",
+				req->queued, req->dns, req->connect, req->tls, req->ttfb, req->total,
+				req->bytes, req->httpcode, req->label);
+	}
+} /* }}} */
+
+void stats_report_json(void) /* {{{ */
+{
+	static const char *phases[PHASE_MAX] = {
+		"alpm", "pkgcache", "queue", "network", "json", "pkgbuild", "extract",
+		"output"
+	};
+	const alpm_list_t *i;
+	const unsigned char *buf;
+	yajl_gen gen;
+	size_t len;
+	int n;
+
+#define GEN_KEY(k) yajl_gen_string(gen, (const unsigned char*)(k), strlen(k))
+	gen = yajl_gen_alloc(NULL);
+	if(!gen) {
+		return;
+	}
+
+	yajl_gen_map_open(gen);
+	GEN_KEY("wall");
+	yajl_gen_double(gen, stats_now() - stats.start);
+
+	GEN_KEY("phases");
+	yajl_gen_map_open(gen);
+	for(n = 0; n < PHASE_MAX; n++) {
+		GEN_KEY(phases[n]);
+		yajl_gen_double(gen, stats.phase[n]);
+	}
+	yajl_gen_map_close(gen);
+
+	GEN_KEY("bytes");
+	yajl_gen_double(gen, stats.bytes);
+	GEN_KEY("queuewait");
+	yajl_gen_double(gen, stats.queuewait);
+	GEN_KEY("maxconnections");
+	yajl_gen_integer(gen, cfg.maxthreads);
+	GEN_KEY("peakconnections");
+	yajl_gen_integer(gen, stats.peak);
+	GEN_KEY("avgconnections");
+	yajl_gen_double(gen, stats.phase[PHASE_NETWORK] > 0 ?
+			stats.busy / stats.phase[PHASE_NETWORK] : 0);
+	GEN_KEY("handshakes");
+	yajl_gen_integer(gen, stats.handshakes);
+	GEN_KEY("reused");
+	yajl_gen_integer(gen, stats.reused);
+	GEN_KEY("sharelocks");
+	yajl_gen_integer(gen, stats.sharelocks);
+
+	GEN_KEY("requests");
+	yajl_gen_array_open(gen);
+	for(i = stats.requests; i; i = alpm_list_next(i)) {
+		const struct reqstat_t *req = i->data;
+
+		yajl_gen_map_open(gen);
+		GEN_KEY("request");
+		yajl_gen_string(gen, (const unsigned char*)req->label, strlen(req->label));
+		GEN_KEY("http");
+		yajl_gen_integer(gen, req->httpcode);
+		GEN_KEY("queued");
+		yajl_gen_double(gen, req->queued);
+		GEN_KEY("dns");
+		yajl_gen_double(gen, req->dns);
+		GEN_KEY("connect");
+		yajl_gen_double(gen, req->connect);
+		GEN_KEY("tls");
+		yajl_gen_double(gen, req->tls);
+		GEN_KEY("ttfb");
+		yajl_gen_double(gen, req->ttfb);
+		GEN_KEY("total");
+		yajl_gen_double(gen, req->total);
+		GEN_KEY("bytes");
+		yajl_gen_double(gen, req->bytes);
+		yajl_gen_map_close(gen);
+	}
+	yajl_gen_array_close(gen);
+	yajl_gen_map_close(gen);
+#undef GEN_KEY
+
+	if(yajl_gen_get_buf(gen, &buf, &len) == yajl_gen_status_ok) {
+		fwrite(buf, 1, len, stderr);
+		fputc('\n', stderr);
+	}
+	yajl_gen_free(gen);
+} /* }}} */
+
+void stats_transfer(struct transfer_t *t) /* {{{ */
+{
+	struct reqstat_t *req;
+
+	if(!cfg.stats) {
+		return;
+	}
+
+	MALLOC(req, sizeof(struct reqstat_t), return);
+	req->label = strdup(t->label);
+	req->queued = t->started - t->queued;
+
+#if LIBCURL_VERSION_NUM >= 0x073d00
+#define CURL_TIME(info, out) do { \
+		curl_off_t val = 0; \
+		curl_easy_getinfo(t->curl, info##_T, &val); \
+		out = val / 1e6; \
+	} while(0)
+	{
+		curl_off_t bytes = 0;
+		curl_easy_getinfo(t->curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+		req->bytes = (double)bytes;
+	}
+#else
+#define CURL_TIME(info, out) curl_easy_getinfo(t->curl, info, &out)
+	curl_easy_getinfo(t->curl, CURLINFO_SIZE_DOWNLOAD, &req->bytes);
+#endif
+	CURL_TIME(CURLINFO_NAMELOOKUP_TIME, req->dns);
+	CURL_TIME(CURLINFO_CONNECT_TIME, req->connect);
+	CURL_TIME(CURLINFO_APPCONNECT_TIME, req->tls);
+	CURL_TIME(CURLINFO_STARTTRANSFER_TIME, req->ttfb);
+	CURL_TIME(CURLINFO_TOTAL_TIME, req->total);
+#undef CURL_TIME
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &req->httpcode);
+
+	/* a request that didn't open a connection rode on one already up */
+	{
+		long connects = 0;
+		curl_easy_getinfo(t->curl, CURLINFO_NUM_CONNECTS, &connects);
+		if(connects == 0) {
+			stats.reused++;
+		} else if(req->tls > 0) {
+			stats.handshakes++;
+		}
+	}
+
+	stats.bytes += req->bytes;
+	stats.queuewait += req->queued;
+	stats.requests = alpm_list_add(stats.requests, req);
+} /* }}} */
+
+void stream_drain(void) /* {{{ */
+{
+	/* everything in here was printed by the parser already */
+	streaming.drained += alpm_list_count(results);
+	alpm_list_free_inner(results, aurpkg_free);
+	alpm_list_free(results);
+	results = NULL;
+} /* }}} */
+
+void stream_pkg(struct aurpkg_t *pkg) /* {{{ */
+{
+	double t0 = stats_now();
+
+	streaming.printfn(pkg);
+	outbuf_flush();
+	fflush(stdout);
+	stats_add(PHASE_OUTPUT, t0);
+} /* }}} */
+
+unsigned long long strhash(const char *str) /* {{{ */
+{
+	/* 64 bit FNV-1a */
+	unsigned long long hash = 14695981039346656037ULL;
+
+	while(*str) {
+		hash ^= (unsigned char)*str++;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+} /* }}} */
+
+int strings_init(void) /* {{{ */
+{
+	MALLOC(colstr, sizeof(struct strings_t), return 1);
+
+	if(cfg.color > 0) {
+		colstr->error = BOLDRED "::" NC;
+		colstr->warn = BOLDYELLOW "::" NC;
+		colstr->info = BOLDBLUE "::" NC;
+		colstr->pkg = BOLD;
+		colstr->repo = BOLDMAGENTA;
+		colstr->url = BOLDCYAN;
+		colstr->ood = BOLDRED;
+		colstr->utd = BOLDGREEN;
+		colstr->nc = NC;
+	} else {
+		colstr->error = "error:";
+		colstr->warn = "warning:";
+		colstr->info = "::";
+		colstr->pkg = "";
+		colstr->repo = "";
+		colstr->url = "";
+		colstr->ood = "";
+		colstr->utd = "";
+		colstr->nc = "";
+	}
+
+	/* guard against delim being something other than LIST_DELIM if extinfo
+	 * and format aren't provided */
+	cfg.delim = (cfg.extinfo && cfg.format) ? cfg.delim : LIST_DELIM;
+
+	return 0;
+} /* }}} */
+
+int strset_add(struct strset_t *set, const char *key) /* {{{ */
+{
+	/* the set keeps its own copy of key. returns 0 if it was already present */
+	char **slot;
+
+	if((set->count + 1) * 2 > set->size && strset_grow(set) != 0) {
+		return -1;
+	}
+
+	slot = strset_slot(set, key);
+	if(*slot) {
+		return 0;
+	}
+
+	*slot = strdup(key);
+	if(!*slot) {
+		ALLOC_FAIL(strlen(key) + 1);
+		return -1;
+	}
+	set->count++;
+
+	return 1;
+} /* }}} */
+
+int strset_contains(const struct strset_t *set, const char *key) /* {{{ */
+{
+	return set->size > 0 && *strset_slot(set, key) != NULL;
 } /* }}} */
 
-int parse_options(int argc, char *argv[]) /* {{{ */
+void strset_free(struct strset_t *set) /* {{{ */
 {
-	int opt, option_index = 0;
+	size_t i;
 
-	static const struct option opts[] = {
-		/* operations */
-		{"download",      no_argument,        0, 'd'},
-		{"info",          no_argument,        0, 'i'},
-		{"msearch",       no_argument,        0, 'm'},
-		{"search",        no_argument,        0, 's'},
-		{"update",        no_argument,        0, 'u'},
+	for(i = 0; i < set->size; i++) {
+		free(set->keys[i]);
+	}
+	FREE(set->keys);
+	FREE(set->vals);
+	set->size = set->count = 0;
+} /* }}} */
 
-		/* options */
-		{"brief",         no_argument,        0, 'b'},
-		{"color",         optional_argument,  0, 'c'},
-		{"debug",         no_argument,        0, OP_DEBUG},
-		{"force",         no_argument,        0, 'f'},
-		{"format",        required_argument,  0, OP_FORMAT},
-		{"from-pkgbuild", no_argument,        0, 'p'},
-		{"help",          no_argument,        0, 'h'},
-		{"ignore",        required_argument,  0, OP_IGNOREPKG},
-		{"ignore-ood",    no_argument,        0, 'o'},
-		{"no-ignore-ood", no_argument,        0, OP_NOIGNOREOOD},
-		{"ignorerepo",    optional_argument,  0, OP_IGNOREREPO},
-		{"listdelim",     required_argument,  0, OP_LISTDELIM},
-		{"quiet",         no_argument,        0, 'q'},
-		{"target",        required_argument,  0, 't'},
-		{"threads",       required_argument,  0, OP_THREADS},
-		{"timeout",       required_argument,  0, OP_TIMEOUT},
-		{"verbose",       no_argument,        0, 'v'},
-		{"version",       no_argument,        0, 'V'},
-		{0, 0, 0, 0}
-	};
+void *strset_get(const struct strset_t *set, const char *key) /* {{{ */
+{
+	char **slot;
 
-	while((opt = getopt_long(argc, argv, "bc::dfhimopqst:uvV", opts, &option_index)) != -1) {
-		char *token;
+	if(set->size == 0) {
+		return NULL;
+	}
 
-		switch(opt) {
-			/* operations */
-			case 's':
-				cfg.opmask |= OP_SEARCH;
-				break;
-			case 'u':
-				cfg.opmask |= OP_UPDATE;
-				break;
-			case 'i':
-				if(!(cfg.opmask & OP_INFO)) {
-					cfg.opmask |= OP_INFO;
-				} else {
-					cfg.extinfo |= 1;
-				}
-				break;
-			case 'd':
-				if(!(cfg.opmask & OP_DOWNLOAD)) {
-					cfg.opmask |= OP_DOWNLOAD;
-				} else {
-					cfg.getdeps |= 1;
-				}
-				break;
-			case 'm':
-				cfg.opmask |= OP_MSEARCH;
-				break;
+	slot = strset_slot(set, key);
 
-			/* options */
-			case 'b':
-				cfg.logmask |= LOG_BRIEF;
-				break;
-			case 'c':
-				if(!optarg || STREQ(optarg, "auto")) {
-					if(isatty(fileno(stdout))) {
-						cfg.color = 1;
-					} else {
-						cfg.color = 0;
-					}
-				} else if(STREQ(optarg, "always")) {
-					cfg.color = 1;
-				} else if(STREQ(optarg, "never")) {
-					cfg.color = 0;
-				} else {
-					fprintf(stderr, "invalid argument to --color\n");
-					return 1;
-				}
-				break;
-			case 'f':
-				cfg.force |= 1;
-				break;
-			case 'h':
-				usage();
-				return 1;
-			case 'q':
-				cfg.quiet |= 1;
-				break;
-			case 't':
-				cfg.dlpath = strdup(optarg);
-				break;
-			case 'v':
-				cfg.logmask |= LOG_VERBOSE;
-				break;
-			case 'V':
-				version();
-				return 2;
-			case OP_DEBUG:
-				cfg.logmask |= LOG_DEBUG;
-				break;
-			case OP_FORMAT:
-				cfg.format = optarg;
-				break;
-			case 'o':
-				cfg.ignoreood = 1;
-				break;
-			case 'p':
-				cfg.frompkgbuild |= 1;
-				break;
-			case OP_IGNOREPKG:
-				for(token = strtok(optarg, ","); token; token = strtok(NULL, ",")) {
-					cwr_printf(LOG_DEBUG, "ignoring package: %s\n", token);
-					cfg.ignore.pkgs = alpm_list_add(cfg.ignore.pkgs, strdup(token));
-				}
-				break;
-			case OP_IGNOREREPO:
-				if(!optarg) {
-					cfg.skiprepos |= 1;
-				} else {
-					for(token = strtok(optarg, ","); token; token = strtok(NULL, ",")) {
-						cwr_printf(LOG_DEBUG, "ignoring repos: %s\n", token);
-						cfg.ignore.repos = alpm_list_add(cfg.ignore.repos, strdup(token));
-					}
-				}
-				break;
-			case OP_NOIGNOREOOD:
-				cfg.ignoreood = 0;
-				break;
-			case OP_LISTDELIM:
-				cfg.delim = optarg;
-				break;
-			case OP_THREADS:
-				cfg.maxthreads = strtol(optarg, &token, 10);
-				if(*token != '\0' || cfg.maxthreads <= 0) {
-					fprintf(stderr, "error: invalid argument to --threads\n");
-					return 1;
-				}
-				break;
-			case OP_TIMEOUT:
-				cfg.timeout = strtol(optarg, &token, 10);
-				if(*token != '\0') {
-					fprintf(stderr, "error: invalid argument to --timeout\n");
-					return 1;
-				}
-				break;
-			case '?':
-			default:
-				return 1;
+	return *slot ? set->vals[slot - set->keys] : NULL;
+} /* }}} */
+
+int strset_grow(struct strset_t *set) /* {{{ */
+{
+	struct strset_t newset;
+	size_t i;
+
+	newset.size = set->size ? set->size * 2 : 64;
+	newset.count = set->count;
+	CALLOC(newset.keys, newset.size, sizeof(char*), return 1);
+	CALLOC(newset.vals, newset.size, sizeof(void*), free(newset.keys); return 1);
+
+	for(i = 0; i < set->size; i++) {
+		if(set->keys[i]) {
+			char **slot = strset_slot(&newset, set->keys[i]);
+			*slot = set->keys[i];
+			newset.vals[slot - newset.keys] = set->vals[i];
 		}
 	}
 
-	if(!cfg.opmask) {
-		return 3;
-	}
+	free(set->keys);
+	free(set->vals);
+	*set = newset;
 
-#define NOT_EXCL(val) (cfg.opmask & (val) && (cfg.opmask & ~(val)))
-	/* check for invalid operation combos */
-	if(NOT_EXCL(OP_INFO) || NOT_EXCL(OP_SEARCH) || NOT_EXCL(OP_MSEARCH) ||
-			NOT_EXCL(OP_UPDATE|OP_DOWNLOAD)) {
-		fprintf(stderr, "error: invalid operation\n");
-		return 2;
-	}
+	return 0;
+} /* }}} */
 
-	while(optind < argc) {
-		if(!alpm_list_find_str(cfg.targets, argv[optind])) {
-			cwr_printf(LOG_DEBUG, "adding target: %s\n", argv[optind]);
-			cfg.targets = alpm_list_add(cfg.targets, strdup(argv[optind]));
-		}
-		optind++;
+int strset_put(struct strset_t *set, const char *key, void *val) /* {{{ */
+{
+	if(strset_add(set, key) < 0) {
+		return -1;
 	}
 
+	set->vals[strset_slot(set, key) - set->keys] = val;
+
 	return 0;
 } /* }}} */
 
-int pkg_is_binary(const char *pkg) /* {{{ */
+char **strset_slot(const struct strset_t *set, const char *key) /* {{{ */
 {
-	const char *db = alpm_provides_pkg(pkg);
+	/* open addressing with linear probing. the table is never more than half
+	 * full, so there's always an empty slot to stop on */
+	size_t mask = set->size - 1, i = strhash(key) & mask;
 
-	if(db) {
-		cwr_fprintf(stderr, LOG_BRIEF, BRIEF_WARN "\t%s\t", pkg);
-		cwr_fprintf(stderr, LOG_WARN, "%s%s%s is available in %s%s%s\n",
-				colstr->pkg, pkg, colstr->nc,
-				colstr->repo, db, colstr->nc);
-		return 1;
+	while(set->keys[i] && !STREQ(set->keys[i], key)) {
+		i = (i + 1) & mask;
 	}
 
-	return 0;
+	return &set->keys[i];
 } /* }}} */
 
-void pkgbuild_get_extinfo(char *pkgbuild, alpm_list_t **details[]) /* {{{ */
+size_t strtrim(char *str) /* {{{ */
 {
-	char *lineptr;
+	char *left = str, *right;
 
-	for(lineptr = pkgbuild; lineptr; lineptr = strchr(lineptr, '\n')) {
-		char *arrayend;
-		int depth = 1, type = 0;
-		alpm_list_t **deplist;
-		size_t linelen;
+	if(!str || *str == '\0') {
+		return 0;
+	}
 
-		linelen = strtrim(++lineptr);
-		if(!linelen || *lineptr == '#') {
-			continue;
-		}
+	while(isspace((unsigned char)*left)) {
+		left++;
+	}
+	if(left != str) {
+		memmove(str, left, (strlen(left) + 1));
+	}
 
-		if(STR_STARTS_WITH(lineptr, PKGBUILD_DEPENDS)) {
-			deplist = details[PKGDETAIL_DEPENDS];
-		} else if(STR_STARTS_WITH(lineptr, PKGBUILD_MAKEDEPENDS)) {
-			deplist = details[PKGDETAIL_MAKEDEPENDS];
-		} else if(STR_STARTS_WITH(lineptr, PKGBUILD_OPTDEPENDS)) {
-			deplist = details[PKGDETAIL_OPTDEPENDS];
-			type = PKGDETAIL_OPTDEPENDS;
-		} else if(STR_STARTS_WITH(lineptr, PKGBUILD_PROVIDES)) {
-			deplist = details[PKGDETAIL_PROVIDES];
-		} else if(STR_STARTS_WITH(lineptr, PKGBUILD_REPLACES)) {
-			deplist = details[PKGDETAIL_REPLACES];
-		} else if(STR_STARTS_WITH(lineptr, PKGBUILD_CONFLICTS)) {
-			deplist = details[PKGDETAIL_CONFLICTS];
-		} else {
-			continue;
-		}
+	if(*str == '\0') {
+		return 0;
+	}
 
-		if(deplist) {
-			char *arrayptr = (char*)memchr(lineptr, '(', linelen) + 1;
-			for(arrayend = arrayptr; depth; arrayend++) {
-				switch(*arrayend) {
-					case ')':
-						depth--;
-						break;
-					case '(':
-						depth++;
-						break;
-				}
-			}
-			*(arrayend - 1) = '\0';
-			*deplist = parse_bash_array(*deplist, arrayptr, type);
-			lineptr = arrayend;
-		}
+	right = (char*)rawmemchr(str, '\0') - 1;
+	while(isspace((unsigned char)*right)) {
+		right--;
 	}
+	*++right = '\0';
+
+	return right - left;
 } /* }}} */
 
-int print_escaped(const char *delim) /* {{{ */
+void *syncindex_build(void UNUSED *arg) /* {{{ */
 {
-	const char *f;
-	int out = 0;
+	const alpm_list_t *i, *j;
+	double t0 = stats_now();
 
-	for(f = delim; *f != '\0'; f++) {
-		if(*f == '\\') {
-			switch(*++f) {
-				case '\\':
-					fputc('\\', stdout);
-					break;
-				case '"':
-					fputc('\"', stdout);
-					break;
-				case 'a':
-					fputc('\a', stdout);
-					break;
-				case 'b':
-					fputc('\b', stdout);
-					break;
-				case 'e': /* \e is nonstandard */
-					fputc('\033', stdout);
-					break;
-				case 'n':
-					fputc('\n', stdout);
-					break;
-				case 'r':
-					fputc('\r', stdout);
-					break;
-				case 't':
-					fputc('\t', stdout);
-					break;
-				case 'v':
-					fputc('\v', stdout);
-					break;
-				++out;
-			}
-		} else {
-			fputc(*f, stdout);
-			++out;
+	for(i = alpm_option_get_syncdbs(pmhandle); i; i = alpm_list_next(i)) {
+		for(j = alpm_db_get_pkgcache(i->data); j; j = alpm_list_next(j)) {
+			strset_add(&syncindex.names, alpm_pkg_get_name(j->data));
 		}
 	}
 
-	return(out);
+	/* alpm_find_foreign_pkgs walks this next. load it here while we're off the
+	 * main thread anyways */
+	alpm_db_get_pkgcache(db_local);
+
+	syncindex.elapsed = stats_now() - t0;
+	syncindex.ready = 1;
+
+	return NULL;
 } /* }}} */
 
-void print_extinfo_list(alpm_list_t *list, const char *fieldname, const char *delim, int wrap) /* {{{ */
+void syncindex_free(void) /* {{{ */
 {
-	const alpm_list_t *next, *i;
-	size_t cols, count = 0;
+	syncindex_wait();
+	strset_free(&syncindex.names);
+	syncindex.ready = 0;
+} /* }}} */
 
-	if(!list) {
+void syncindex_start(void) /* {{{ */
+{
+	/* a daemon built this already */
+	if(syncindex.running || syncindex.ready) {
 		return;
 	}
 
-	cols = wrap ? getcols() : 0;
+	/* nothing else touches alpm until syncindex_wait, so this can run
+	 * alongside curl's startup */
+	if(pthread_create(&syncindex.thread, NULL, syncindex_build, NULL) == 0) {
+		syncindex.running = 1;
+	} else {
+		syncindex_build(NULL);
+	}
+} /* }}} */
 
-	if(fieldname) {
-		count += printf("%-*s: ", INFO_INDENT - 2, fieldname);
+void syncindex_wait(void) /* {{{ */
+{
+	if(syncindex.running) {
+		pthread_join(syncindex.thread, NULL);
+		syncindex.running = 0;
+		stats.phase[PHASE_PKGCACHE] += syncindex.elapsed;
 	}
+} /* }}} */
 
-	for(i = list; i; i = next) {
-		size_t data_len = strlen(i->data);
-		next = alpm_list_next(i);
-		if(wrap && cols > 0 && count + data_len >= cols) {
-			printf("%-*c", INFO_INDENT + 1, '\n');
-			count = INFO_INDENT;
+void targets_parse(struct response_t *carry, char *buf, size_t len, /* {{{ */
+		alpm_list_t **targets, struct strset_t *set)
+{
+	char *p = buf, *end = buf + len;
+
+	/* the input ended, so whatever was cut off by the last block is whole */
+	if(len == 0) {
+		if(carry->size && list_add_unique(targets, set, carry->data)) {
+			cwr_printf(LOG_DEBUG, "adding target: %s\n", carry->data);
+		}
+		carry->size = 0;
+		return;
+	}
+
+	while(p < end) {
+		char *target = p;
+
+		while(p < end && !isspace((unsigned char)*p)) {
+			p++;
+		}
+
+		/* the rest of this target is in the next block */
+		if(p == end) {
+			if(response_reserve(carry, carry->size + (p - target) + 1) == 0) {
+				memcpy(carry->data + carry->size, target, p - target);
+				carry->size += p - target;
+				carry->data[carry->size] = '\0';
+			}
+			break;
+		}
+
+		*p++ = '\0';
+		if(carry->size) {
+			if(response_reserve(carry, carry->size + strlen(target) + 1) == 0) {
+				strcpy(carry->data + carry->size, target);
+			}
+			target = carry->data;
+			carry->size = 0;
 		}
-		count += data_len;
-		fputs(i->data, stdout);
-		if(next) {
-			count += print_escaped(delim);
+
+		/* runs of whitespace leave empty targets behind */
+		if(*target && list_add_unique(targets, set, target)) {
+			cwr_printf(LOG_DEBUG, "adding target: %s\n", target);
 		}
 	}
-	fputc('\n', stdout);
 } /* }}} */
 
-void print_pkg_formatted(struct aurpkg_t *pkg) /* {{{ */
+void task_download(void *arg) /* {{{ */
 {
-	const char *p, *end;
-	char fmt[32], buf[64];
-	int len;
+	if(!pkg_is_binary(arg)) {
+		download(arg);
+	}
+} /* }}} */
 
-	end = rawmemchr(cfg.format, '\0');
+void task_multiinfo(void *arg) /* {{{ */
+{
+	char *url;
 
-	for(p = cfg.format; p < end; p++) {
-		len = 0;
-		if(*p == '%') {
-			len = strspn(p + 1 + len, printf_flags);
-			len += strspn(p + 1 + len, digits);
-			snprintf(fmt, len + 3, "%ss", p);
-			fmt[len + 1] = 's';
-			p += len + 1;
-			switch(*p) {
-				/* simple attributes */
-				case 'a':
-					snprintf(buf, 64, "%ld", pkg->lastmod);
-					printf(fmt, buf);
-					break;
-				case 'c':
-					printf(fmt, aur_cat[pkg->cat]);
-					break;
-				case 'd':
-					printf(fmt, pkg->desc);
-					break;
-				case 'i':
-					snprintf(buf, 64, "%d", pkg->id);
-					printf(fmt, buf);
-					break;
-				case 'l':
-					printf(fmt, pkg->lic);
-					break;
-				case 'm':
-					printf(fmt, pkg->maint ? pkg->maint : "(orphan)");
-					break;
-				case 'n':
-					printf(fmt, pkg->name);
-					break;
-				case 'o':
-					snprintf(buf, 64, "%d", pkg->votes);
-					printf(fmt, buf);
-					break;
-				case 'p':
-					snprintf(buf, 64, AUR_PKG_URL_FORMAT "%s", pkg->name);
-					printf(fmt, buf);
-					break;
-				case 's':
-					snprintf(buf, 64, "%ld", pkg->firstsub);
-					printf(fmt, buf);
-					break;
-				case 't':
-					printf(fmt, pkg->ood ? "yes" : "no");
-					break;
-				case 'u':
-					printf(fmt, pkg->url);
-					break;
-				case 'v':
-					printf(fmt, pkg->ver);
-					break;
-				/* list based attributes */
-				case 'C':
-					print_extinfo_list(pkg->conflicts, NULL, cfg.delim, 0);
-					break;
-				case 'D':
-					print_extinfo_list(pkg->depends, NULL, cfg.delim, 0);
-					break;
-				case 'M':
-					print_extinfo_list(pkg->makedepends, NULL, cfg.delim, 0);
-					break;
-				case 'O':
-					print_extinfo_list(pkg->optdepends, NULL, cfg.delim, 0);
-					break;
-				case 'P':
-					print_extinfo_list(pkg->provides, NULL, cfg.delim, 0);
-					break;
-				case 'R':
-					print_extinfo_list(pkg->replaces, NULL, cfg.delim, 0);
-					break;
-				case '%':
-					fputc('%', stdout);
-					break;
-				default:
-					fputc('?', stdout);
-					break;
-			}
-		} else if(*p == '\\') {
-			char ebuf[3];
-			ebuf[0] = *p;
-			ebuf[1] = *++p;
-			ebuf[2] = '\0';
-			print_escaped(ebuf);
-		} else {
-			fputc(*p, stdout);
-		}
+	url = url_multiinfo(arg);
+	if(!url) {
+		return;
 	}
 
-	fputc('\n', stdout);
-
-	return;
+	curl_get_url_as_pkglist(url, AUR_QUERY_TYPE_MULTI, task_multiinfo_cb, NULL);
+	free(url);
 } /* }}} */
 
-void print_pkg_info(struct aurpkg_t *pkg) /* {{{ */
+void task_multiinfo_cb(void *pkglist, void UNUSED *arg) /* {{{ */
 {
-	char datestring[42];
-	struct tm *ts;
-	alpm_pkg_t *ipkg;
+	const alpm_list_t *i;
 
-	printf(PKG_REPO "     : %saur%s\n", colstr->repo, colstr->nc);
-	printf(NAME "           : %s%s%s", colstr->pkg, pkg->name, colstr->nc);
-	if((ipkg = alpm_db_get_pkg(db_local, pkg->name))) {
-		const char *instcolor;
-		if(alpm_pkg_vercmp(pkg->ver, alpm_pkg_get_version(ipkg)) > 0) {
-			instcolor = colstr->ood;
-		} else {
-			instcolor = colstr->utd;
+	if(cfg.extinfo) {
+		for(i = pkglist; i; i = alpm_list_next(i)) {
+			aurpkg_get_extinfo(i->data);
 		}
-		printf(" %s[%sinstalled%s]%s", colstr->url, instcolor, colstr->url, colstr->nc);
 	}
-	fputc('\n', stdout);
 
-	printf(VERSION "        : %s%s%s\n",
-			pkg->ood ? colstr->ood : colstr->utd, pkg->ver, colstr->nc);
-	printf(URL "            : %s%s%s\n", colstr->url, pkg->url, colstr->nc);
-	printf(PKG_AURPAGE "       : %s" AUR_PKG_URL_FORMAT "%s%s\n",
-			colstr->url, pkg->name, colstr->nc);
+	results = alpm_list_join(results, pkglist);
+} /* }}} */
 
-	print_extinfo_list(pkg->depends, PKG_DEPENDS, LIST_DELIM, 1);
-	print_extinfo_list(pkg->makedepends, PKG_MAKEDEPENDS, LIST_DELIM, 1);
-	print_extinfo_list(pkg->provides, PKG_PROVIDES, LIST_DELIM, 1);
-	print_extinfo_list(pkg->conflicts, PKG_CONFLICTS, LIST_DELIM, 1);
+void task_query(void *arg) /* {{{ */
+{
+	const char *argstr;
+	char *escaped, *url;
+	int span = 0;
 
-	if(pkg->optdepends) {
-		const alpm_list_t *i;
-		printf(PKG_OPTDEPENDS "  : %s\n", (const char*)pkg->optdepends->data);
-		for(i = pkg->optdepends->next; i; i = alpm_list_next(i)) {
-			printf("%-*s%s\n", INFO_INDENT, "", (const char*)i->data);
-		}
-	}
+	/* find a valid chunk of search string */
+	if(cfg.opmask & OP_SEARCH) {
+		for(argstr = arg; *argstr; argstr++) {
+			span = strcspn(argstr, REGEX_CHARS);
 
-	print_extinfo_list(pkg->replaces, PKG_REPLACES, LIST_DELIM, 1);
+			/* given 'cow?', we can't include w in the search */
+			if(argstr[span] == '?' || argstr[span] == '*') {
+				span--;
+			}
 
-	printf(PKG_CAT "       : %s\n"
-				 PKG_LICENSE "        : %s\n"
-				 PKG_NUMVOTES "          : %d\n"
-				 PKG_OOD "    : %s%s%s\n",
-				 aur_cat[pkg->cat], pkg->lic, pkg->votes,
-				 pkg->ood ? colstr->ood : colstr->utd,
-				 pkg->ood ? "Yes" : "No", colstr->nc);
+			/* a string inside [] or {} cannot be a valid span */
+			if(strchr("[{", *argstr)) {
+				argstr = strpbrk(argstr + span, "]}");
+				if(!argstr) {
+					cwr_fprintf(stderr, LOG_ERROR, "invalid regular expression: %s\n", (const char*)arg);
+					return;
+				}
+				continue;
+			}
 
-	printf(PKG_MAINT "     : %s\n", pkg->maint ? pkg->maint : "(orphan)");
+			if(span >= 2) {
+				break;
+			}
+		}
 
-	ts = localtime(&pkg->firstsub);
-	strftime(datestring, 42, PKG_TIMEFMT, ts);
-	printf(PKG_FIRSTSUB "      : %s\n", datestring);
+		if(span < 2) {
+			cwr_fprintf(stderr, LOG_ERROR, "search string '%s' too short\n", (const char*)arg);
+			return;
+		}
+	} else {
+		argstr = arg;
+	}
 
-	ts = localtime(&pkg->lastmod);
-	strftime(datestring, 42, PKG_TIMEFMT, ts);
-	printf(PKG_LASTMOD "  : %s\n", datestring);
+	escaped = url_escape((char*)argstr, span, NULL);
+	if(cfg.opmask & OP_SEARCH) {
+		cwr_asprintf(&url, AUR_RPC_URL, cfg.aururl, AUR_QUERY_TYPE_SEARCH, escaped);
+	} else if(cfg.opmask & OP_MSEARCH) {
+		cwr_asprintf(&url, AUR_RPC_URL, cfg.aururl, AUR_QUERY_TYPE_MSRCH, escaped);
+	} else {
+		cwr_asprintf(&url, AUR_RPC_URL, cfg.aururl, AUR_QUERY_TYPE_INFO, escaped);
+	}
+	curl_free(escaped);
 
-	printf(PKG_DESC "    : ");
-	indentprint(pkg->desc, INFO_INDENT);
-	printf("\n\n");
+	curl_get_url_as_pkglist(url, arg, task_query_cb, NULL);
+	free(url);
 } /* }}} */
 
-void print_pkg_search(struct aurpkg_t *pkg) /* {{{ */
+void task_query_cb(void *pkglist, void UNUSED *arg) /* {{{ */
 {
-	if(cfg.quiet) {
-		printf("%s%s%s\n", colstr->pkg, pkg->name, colstr->nc);
-	} else {
-		alpm_pkg_t *ipkg;
-		printf("%saur/%s%s%s %s%s%s%s (%d)", colstr->repo, colstr->nc, colstr->pkg,
-				pkg->name, pkg->ood ? colstr->ood : colstr->utd, pkg->ver,
-				NCFLAG(pkg->ood, " <!>"), colstr->nc, pkg->votes);
-		if((ipkg = alpm_db_get_pkg(db_local, pkg->name))) {
-			const char *instcolor;
-			if(alpm_pkg_vercmp(pkg->ver, alpm_pkg_get_version(ipkg)) > 0) {
-				instcolor = colstr->ood;
-			} else {
-				instcolor = colstr->utd;
-			}
-			printf(" %s[%sinstalled%s]%s", colstr->url, instcolor, colstr->url, colstr->nc);
-		}
-		printf("\n    ");
-		indentprint(pkg->desc, SRCH_INDENT);
-		fputc('\n', stdout);
+	if(pkglist && cfg.extinfo) {
+		aurpkg_get_extinfo(((alpm_list_t*)pkglist)->data);
 	}
+
+	results = alpm_list_join(results, pkglist);
 } /* }}} */
 
-void print_results(alpm_list_t *results, void (*printfn)(struct aurpkg_t*)) /* {{{ */
+void task_update(void *arg) /* {{{ */
 {
 	const alpm_list_t *i;
-	struct aurpkg_t *prev = NULL;
+	char *url;
 
-	if(!printfn) {
-		return;
+	for(i = arg; i; i = alpm_list_next(i)) {
+		cwr_printf(LOG_VERBOSE, "Checking %s%s%s for updates...\n",
+				colstr->pkg, (const char*)i->data, colstr->nc);
 	}
 
-	if(!results && (cfg.opmask & OP_INFO)) {
-		cwr_fprintf(stderr, LOG_ERROR, "no results found\n");
+	url = url_multiinfo(arg);
+	if(!url) {
 		return;
 	}
 
-	for(i = results; i; i = alpm_list_next(i)) {
-		struct aurpkg_t *pkg = i->data;
-
-		/* don't print duplicates */
-		if(!prev || aurpkg_cmp(pkg, prev) != 0) {
-			printfn(pkg);
-		}
-		prev = pkg;
-	}
+	curl_get_url_as_pkglist(url, AUR_QUERY_TYPE_MULTI, task_update_cb, NULL);
+	free(url);
 } /* }}} */
 
-int resolve_dependencies(CURL *curl, const char *pkgname, const char *subdir) /* {{{ */
+void task_update_cb(void *pkglist, void *arg) /* {{{ */
 {
 	const alpm_list_t *i;
-	alpm_list_t *deplist = NULL;
-	char *filename, *pkgbuild;
-	void *retval;
-
-	curl = curl_init_easy_handle(curl);
+	alpm_list_t *updates = NULL;
 
-	cwr_asprintf(&filename, "%s/%s/PKGBUILD", cfg.dlpath, subdir ? subdir : pkgname);
-
-	pkgbuild = get_file_as_buffer(filename);
-	if(!pkgbuild) {
-		return 1;
+	/* packages replayed from the snapshot must not refresh their own entries */
+	if(arg != &snapshot) {
+		snapshot_record(pkglist);
 	}
 
-	alpm_list_t **pkg_details[PKGDETAIL_MAX] = {
-		&deplist, &deplist, NULL, NULL, NULL, NULL
-	};
+	for(i = pkglist; i; i = alpm_list_next(i)) {
+		struct aurpkg_t *aurpkg = i->data;
+		const char *candidate = aurpkg->name;
+		alpm_pkg_t *pmpkg;
 
-	cwr_printf(LOG_DEBUG, "Parsing %s for extended info\n", filename);
-	pkgbuild_get_extinfo(pkgbuild, pkg_details);
-	free(pkgbuild);
-	free(filename);
+		pmpkg = alpm_db_get_pkg(db_local, candidate);
 
-	for(i = deplist; i; i = alpm_list_next(i)) {
-		const char *depend = i->data;
-		char *sanitized = strdup(depend);
+		if(!pmpkg) {
+			cwr_fprintf(stderr, LOG_WARN, "skipping uninstalled package %s\n",
+					candidate);
+			aurpkg_free(aurpkg);
+			continue;
+		}
 
-		sanitized[strcspn(sanitized, "<>=")] = '\0';
+		if(alpm_pkg_vercmp(aurpkg->ver, alpm_pkg_get_version(pmpkg)) <= 0) {
+			aurpkg_free(aurpkg);
+			continue;
+		}
 
-		if(!alpm_list_find_str(cfg.targets, sanitized)) {
-			pthread_mutex_lock(&listlock);
-			cfg.targets = alpm_list_add(cfg.targets, sanitized);
-			pthread_mutex_unlock(&listlock);
-		} else {
-			if(cfg.logmask & LOG_BRIEF &&
-							!alpm_find_satisfier(alpm_db_get_pkgcache(db_local), depend)) {
-					cwr_printf(LOG_BRIEF, "S\t%s\n", sanitized);
+		if(strset_contains(&cfg.ignore.pkgs, candidate) ||
+				strset_contains(&pmignore, candidate)) {
+			if(!cfg.quiet && !(cfg.logmask & LOG_BRIEF)) {
+				cwr_fprintf(stderr, LOG_WARN, "%s%s%s [ignored] %s%s%s -> %s%s%s\n",
+						colstr->pkg, candidate, colstr->nc,
+						colstr->ood, alpm_pkg_get_version(pmpkg), colstr->nc,
+						colstr->utd, aurpkg->ver, colstr->nc);
 			}
-			FREE(sanitized);
+			aurpkg_free(aurpkg);
+			continue;
 		}
 
-		if(sanitized) {
-			if(alpm_find_satisfier(alpm_db_get_pkgcache(db_local), depend)) {
-				cwr_printf(LOG_DEBUG, "%s is already satisified\n", depend);
+		if(cfg.opmask & OP_DOWNLOAD) {
+			task_download(aurpkg->name);
+		} else if(!cfg.json) {
+			if(cfg.quiet) {
+				printf("%s%s%s\n", colstr->pkg, candidate, colstr->nc);
 			} else {
-				if(!pkg_is_binary(depend)) {
-					retval = task_download(curl, sanitized);
-					alpm_list_free_inner(retval, aurpkg_free);
-					alpm_list_free(retval);
-				}
+				cwr_printf(LOG_INFO, "%s%s %s%s%s -> %s%s%s\n",
+						colstr->pkg, candidate,
+						colstr->ood, alpm_pkg_get_version(pmpkg), colstr->nc,
+						colstr->utd, aurpkg->ver, colstr->nc);
 			}
 		}
-	}
 
-	FREELIST(deplist);
+		updates = alpm_list_add(updates, aurpkg);
+	}
+	alpm_list_free(pkglist);
 
-	return 0;
+	results = alpm_list_join(results, updates);
 } /* }}} */
 
-int set_working_dir(void) /* {{{ */
+void transfer_adjust(struct transfer_t *t, int transient) /* {{{ */
 {
-	char *resolved;
-
-	if(!(cfg.opmask & OP_DOWNLOAD)) {
-		FREE(cfg.dlpath);
-		return 0;
+	double latency, now = clock_now();
+
+	/* one overloaded moment tends to fail a whole window's worth of requests.
+	 * only the first of those gets to shrink it. */
+	if(transient) {
+		if(now - transfers.lastcut >= transfers.srtt) {
+			transfers.window /= 2;
+			if(transfers.window < 1) {
+				transfers.window = 1;
+			}
+			transfers.lastcut = now;
+			cwr_printf(LOG_DEBUG, "connection window down to %d\n", transfer_limit());
+		}
+		return;
 	}
 
-	resolved = cfg.dlpath ? realpath(cfg.dlpath, NULL) : getcwd(NULL, 0);
-	if(!resolved) {
-		fprintf(stderr, "error: failed to resolve download path %s: %s\n",
-				cfg.dlpath, strerror(errno));
-		FREE(cfg.dlpath);
-		return 1;
+	if(curl_easy_getinfo(t->curl, CURLINFO_TOTAL_TIME, &latency) != CURLE_OK ||
+			latency <= 0) {
+		return;
 	}
 
-	free(cfg.dlpath);
-	cfg.dlpath = resolved;
-
-	if(access(cfg.dlpath, W_OK) != 0) {
-		fprintf(stderr, "error: cannot write to %s: %s\n",
-				cfg.dlpath, strerror(errno));
-		FREE(cfg.dlpath);
-		return 1;
+	if(transfers.minlatency == 0 || latency < transfers.minlatency) {
+		transfers.minlatency = latency;
 	}
-
-	if(chdir(cfg.dlpath) != 0) {
-		fprintf(stderr, "error: failed to chdir to %s: %s\n", cfg.dlpath,
-				strerror(errno));
-		return 1;
+	transfers.srtt = transfers.srtt == 0 ? latency :
+		transfers.srtt * 0.875 + latency * 0.125;
+
+	/* requests queueing up on the server side show up as latency well before
+	 * they show up as errors. stop growing once that happens. */
+	if(latency <= transfers.minlatency * 2 && transfers.window < cfg.maxthreads) {
+		transfers.window += 1 / transfers.window;
+		if(transfers.window > cfg.maxthreads) {
+			transfers.window = cfg.maxthreads;
+		}
 	}
-
-	return 0;
 } /* }}} */
 
-int strings_init(void) /* {{{ */
+void transfer_cleanup(void) /* {{{ */
 {
-	MALLOC(colstr, sizeof(struct strings_t), return 1);
+	while(transfers.retry) {
+		struct transfer_t *t = transfers.retry;
+		transfers.retry = t->next;
+		transfer_free(t);
+	}
 
-	if(cfg.color > 0) {
-		colstr->error = BOLDRED "::" NC;
-		colstr->warn = BOLDYELLOW "::" NC;
-		colstr->info = BOLDBLUE "::" NC;
-		colstr->pkg = BOLD;
-		colstr->repo = BOLDMAGENTA;
-		colstr->url = BOLDCYAN;
-		colstr->ood = BOLDRED;
-		colstr->utd = BOLDGREEN;
-		colstr->nc = NC;
-	} else {
-		colstr->error = "error:";
-		colstr->warn = "warning:";
-		colstr->info = "::";
-		colstr->pkg = "";
-		colstr->repo = "";
-		colstr->url = "";
-		colstr->ood = "";
-		colstr->utd = "";
-		colstr->nc = "";
+	if(transfers.multi) {
+		curl_multi_cleanup(transfers.multi);
+		transfers.multi = NULL;
 	}
 
-	/* guard against delim being something other than LIST_DELIM if extinfo
-	 * and format aren't provided */
-	cfg.delim = (cfg.extinfo && cfg.format) ? cfg.delim : LIST_DELIM;
+	if(transfers.share) {
+		curl_share_cleanup(transfers.share);
+		transfers.share = NULL;
+	}
 
-	return 0;
+	if(transfers.wakefd[0] >= 0) {
+		close(transfers.wakefd[0]);
+		close(transfers.wakefd[1]);
+		transfers.wakefd[0] = transfers.wakefd[1] = -1;
+	}
+
+	while(bufpool.count > 0) {
+		free(bufpool.bufs[--bufpool.count].data);
+	}
 } /* }}} */
 
-size_t strtrim(char *str) /* {{{ */
+void transfer_free(struct transfer_t *t) /* {{{ */
 {
-	char *left = str, *right;
-
-	if(!str || *str == '\0') {
-		return 0;
+	if(!t) {
+		return;
 	}
 
-	while(isspace((unsigned char)*left)) {
-		left++;
+	if(t->curl) {
+		curl_easy_cleanup(t->curl);
 	}
-	if(left != str) {
-		memmove(str, left, (strlen(left) + 1));
+	if(t->yajl_hand) {
+		yajl_free(t->yajl_hand);
+	}
+	if(t->parse_struct) {
+		FREE(t->parse_struct->aurpkg);
+		arena_release(t->parse_struct->arena);
+		FREE(t->parse_struct);
+	}
+	if(t->headers) {
+		curl_slist_free_all(t->headers);
+	}
+	cache_free(t->cache);
+	if(t->extract) {
+		/* the thread is joined by now, so any wakeup it sent for us is already
+		 * in the pipe. it can't be left there to be read after we're gone */
+		archive_extract_free(t->extract);
+		transfer_wake_drain(t);
 	}
+	response_release(&t->response);
+	FREE(t->url);
+	FREE(t->label);
+	FREE(t);
+} /* }}} */
 
-	if(*str == '\0') {
-		return 0;
+int transfer_init(void) /* {{{ */
+{
+	transfers.multi = curl_multi_init();
+	if(!transfers.multi) {
+		return 1;
 	}
 
-	right = (char*)rawmemchr(str, '\0') - 1;
-	while(isspace((unsigned char)*right)) {
-		right--;
+	/* seeds the retry jitter */
+	srand(getpid() ^ time(NULL));
+
+	/* extraction threads use this to ask for paused transfers to resume */
+	if(pipe2(transfers.wakefd, O_NONBLOCK|O_CLOEXEC) != 0) {
+		transfers.wakefd[0] = transfers.wakefd[1] = -1;
+		return 1;
 	}
-	*++right = '\0';
 
-	return right - left;
+#ifdef CURLPIPE_MULTIPLEX
+	curl_multi_setopt(transfers.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+	/* handles on the same multi already share a connection cache. a share
+	 * object covers the rest. failing to create one only costs us some extra
+	 * lookups and handshakes. */
+	transfers.share = curl_share_init();
+	if(transfers.share) {
+		curl_share_setopt(transfers.share, CURLSHOPT_LOCKFUNC, transfer_share_lock);
+		curl_share_setopt(transfers.share, CURLSHOPT_UNLOCKFUNC, transfer_share_unlock);
+		curl_share_setopt(transfers.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(transfers.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+
+	return 0;
 } /* }}} */
 
-void *task_download(CURL *curl, void *arg) /* {{{ */
+int transfer_is_transient(CURLcode curlstat, long httpcode) /* {{{ */
 {
-	if(pkg_is_binary(arg)) {
-		return NULL;
-	} else {
-		return download(curl, arg);
+	switch(curlstat) {
+		case CURLE_OK:
+			return httpcode == 429 || (httpcode >= 500 && httpcode < 600);
+		case CURLE_COULDNT_RESOLVE_HOST:
+		case CURLE_COULDNT_CONNECT:
+		case CURLE_OPERATION_TIMEDOUT:
+		case CURLE_GOT_NOTHING:
+		case CURLE_SEND_ERROR:
+		case CURLE_RECV_ERROR:
+			return 1;
+		default:
+			return 0;
 	}
 } /* }}} */
 
-void *task_query(CURL *curl, void *arg) /* {{{ */
+int transfer_limit(void) /* {{{ */
 {
-	alpm_list_t *pkglist = NULL;
-	CURLcode curlstat;
-	struct yajl_handle_t *yajl_hand = NULL;
-	const char *argstr;
-	char *escaped, *url;
-	long httpcode;
-	int span = 0;
-	struct yajl_parser_t *parse_struct;
+	return transfers.window < 1 ? 1 : (int)transfers.window;
+} /* }}} */
+
+int transfer_loop(struct task_t *task) /* {{{ */
+{
+	int running;
+
+	/* this is the whole scheduler. jobs come off workq in order and only when a
+	 * connection is free, and every completion runs on this thread, so neither
+	 * the queue nor the results need a lock */
+
+	while(workq || (feed.active && !feed.eof) || pkgbuilds.active || transfers.pending ||
+			transfers.retry || transfers.inflight > 0) {
+		CURLMsg *msg;
+		int msgs_left, feeding;
+
+		/* only hook new jobs when there's room for them on the wire */
+		double t0, json;
+
+		while(workq && transfers.inflight + transfers.npending < transfer_limit()) {
+			double queued = stats_now();
+			void *job;
+
+			if(task->batched) {
+				job = workq_pop_batch();
+			} else {
+				job = workq->data;
+				workq = alpm_list_next(workq);
+			}
 
-	/* find a valid chunk of search string */
-	if(cfg.opmask & OP_SEARCH) {
-		for(argstr = arg; *argstr; argstr++) {
-			span = strcspn(argstr, REGEX_CHARS);
+			task->taskfn(job);
 
-			/* given 'cow?', we can't include w in the search */
-			if(argstr[span] == '?' || argstr[span] == '*') {
-				span--;
+			if(task->batched) {
+				alpm_list_free(job);
 			}
+			stats_add(PHASE_QUEUE, queued);
+		}
 
-			/* a string inside [] or {} cannot be a valid span */
-			if(strchr("[{", *argstr)) {
-				argstr = strpbrk(argstr + span, "]}");
-				if(!argstr) {
-					cwr_fprintf(stderr, LOG_ERROR, "invalid regular expression: %s\n", (const char*)arg);
-					return NULL;
-				}
+		t0 = stats_now();
+		json = stats.phase[PHASE_JSON];
+		if(curl_multi_perform(transfers.multi, &running) != CURLM_OK) {
+			cwr_fprintf(stderr, LOG_ERROR, "curl: failed to perform transfers\n");
+			return 1;
+		}
+		stats_network(t0, json);
+
+		while((msg = curl_multi_info_read(transfers.multi, &msgs_left))) {
+			struct transfer_t *t;
+			CURL *handle;
+			CURLcode curlstat;
+			char *priv;
+
+			if(msg->msg != CURLMSG_DONE) {
 				continue;
 			}
 
-			if(span >= 2) {
-				break;
+			/* msg is invalidated by curl_multi_remove_handle */
+			handle = msg->easy_handle;
+			curlstat = msg->data.result;
+
+			curl_easy_getinfo(handle, CURLINFO_PRIVATE, &priv);
+			t = (struct transfer_t*)priv;
+
+			curl_multi_remove_handle(transfers.multi, handle);
+			transfers.inflight--;
+
+			stats_transfer(t);
+			if(transfer_retry(t, curlstat)) {
+				continue;
+			}
+			t->donefn(t, curlstat);
+			transfer_free(t);
+
+			if(streaming.drain && results) {
+				stream_drain();
 			}
 		}
 
-		if(span < 2) {
-			cwr_fprintf(stderr, LOG_ERROR, "search string '%s' too short\n", (const char*)arg);
-			return NULL;
+		/* retries whose backoff has run out go back on the wire, ahead of
+		 * anything new */
+		if(transfers.retry) {
+			double now = clock_now();
+
+			while(transfers.retry && transfers.retry->retry_at <= now) {
+				struct transfer_t *t = transfers.retry;
+
+				transfers.retry = t->next;
+				t->next = NULL;
+				transfer_start(t);
+			}
 		}
-	} else {
-		argstr = arg;
-	}
 
-	CALLOC(parse_struct, 1, sizeof(struct yajl_parser_t), return NULL);
-	CALLOC(parse_struct->aurpkg, 1, sizeof(struct aurpkg_t), return NULL);
-	yajl_hand = yajl_alloc(&callbacks, NULL, (void*)parse_struct);
+		/* completed transfers make room for pending ones */
+		while(transfers.pending && transfers.inflight < transfer_limit()) {
+			struct transfer_t *t = transfers.pending;
 
-	curl = curl_init_easy_handle(curl);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, yajl_parse_stream);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, yajl_hand);
+			transfers.pending = t->next;
+			if(!transfers.pending) {
+				transfers.pending_tail = NULL;
+			}
+			transfers.npending--;
+			t->next = NULL;
 
-	escaped = url_escape((char*)argstr, span, NULL);
-	if(cfg.opmask & OP_SEARCH) {
-		cwr_asprintf(&url, AUR_RPC_URL, AUR_QUERY_TYPE_SEARCH, escaped);
-	} else if(cfg.opmask & OP_MSEARCH) {
-		cwr_asprintf(&url, AUR_RPC_URL, AUR_QUERY_TYPE_MSRCH, escaped);
-	} else {
-		cwr_asprintf(&url, AUR_RPC_URL, AUR_QUERY_TYPE_INFO, escaped);
-	}
-	curl_easy_setopt(curl, CURLOPT_URL, url);
+			transfer_start(t);
+		}
 
-	cwr_printf(LOG_DEBUG, "[%s]: curl_easy_perform %s\n", (const char *)arg, url);
-	curlstat = curl_easy_perform(curl);
+		/* only read more targets once the queue has run dry. that keeps the
+		 * queue no longer than a block's worth, however much is on stdin. */
+		feeding = feed.active && !feed.eof && !workq;
 
-	if(curlstat != CURLE_OK) {
-		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", (const char*)arg,
-				curl_easy_strerror(curlstat));
-		goto finish;
-	}
+		/* PKGBUILDs that finished parsing before there was a pipe to hear
+		 * about them are already waiting */
+		if(pkgbuilds.active && pkgbuilds.donefd[0] < 0) {
+			pkgbuilds_collect();
+			continue;
+		}
 
-	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpcode);
-	cwr_printf(LOG_DEBUG, "[%s]: server responded with %ld\n", (const char *)arg, httpcode);
-	if(httpcode >= 400) {
-		cwr_fprintf(stderr, LOG_ERROR, "[%s]: server responded with HTTP %ld\n",
-				(const char*)arg, httpcode);
-		goto finish;
-	}
+		if(transfers.inflight > 0 || transfers.retry || feeding || pkgbuilds.active) {
+			struct curl_waitfd waitfd[3] = {
+				{ transfers.wakefd[0], CURL_WAIT_POLLIN, 0 }
+			};
+			unsigned int nfds = 1, feedfd = 0, parsefd = 0;
+			int timeout = 1000;
+
+			if(feeding) {
+				waitfd[nfds].fd = STDIN_FILENO;
+				waitfd[nfds].events = CURL_WAIT_POLLIN;
+				feedfd = nfds++;
+			}
+			if(pkgbuilds.active) {
+				waitfd[nfds].fd = pkgbuilds.donefd[0];
+				waitfd[nfds].events = CURL_WAIT_POLLIN;
+				parsefd = nfds++;
+			}
 
-	yajl_complete_parse(yajl_hand);
+			/* don't sleep through the next retry */
+			if(transfers.retry) {
+				double wait = (transfers.retry->retry_at - clock_now()) * 1000;
+				if(wait < timeout) {
+					timeout = wait < 0 ? 0 : (int)wait + 1;
+				}
+			}
 
-	pkglist = parse_struct->pkglist;
+			t0 = stats_now();
+			json = stats.phase[PHASE_JSON];
+			curl_multi_wait(transfers.multi, waitfd, nfds, timeout, NULL);
+			transfer_wake_drain(NULL);
+			stats_network(t0, json);
 
-	if(pkglist && cfg.extinfo) {
-		struct aurpkg_t *aurpkg;
-		char *pburl, *escaped, *pkgbuild;
+			if(feedfd && waitfd[feedfd].revents) {
+				feed_read();
+			}
+			if(parsefd && waitfd[parsefd].revents) {
+				pkgbuilds_collect();
+			}
+		}
+	}
 
-		aurpkg = pkglist->data;
-		escaped = url_escape(aurpkg->urlpath, 0, "/");
-		cwr_asprintf(&pburl, AUR_BASE_URL, escaped);
-		memcpy(strrchr(pburl, '/') + 1, "PKGBUILD\0", 9);
+	return 0;
+} /* }}} */
 
-		pkgbuild = curl_get_url_as_buffer(curl, pburl);
-		free(escaped);
-		free(pburl);
+struct transfer_t *transfer_new(const char *url, const char *label, /* {{{ */
+		void (*donefn)(struct transfer_t*, CURLcode))
+{
+	struct transfer_t *t;
 
-		alpm_list_t **pkg_details[PKGDETAIL_MAX] = {
-			&aurpkg->depends, &aurpkg->makedepends, &aurpkg->optdepends,
-			&aurpkg->provides, &aurpkg->conflicts, &aurpkg->replaces
-		};
+	MALLOC(t, sizeof(struct transfer_t), return NULL);
 
-		pkgbuild_get_extinfo(pkgbuild, pkg_details);
-		free(pkgbuild);
+	t->curl = curl_init_easy_handle(curl_easy_init());
+	if(!t->curl) {
+		cwr_fprintf(stderr, LOG_ERROR, "curl: failed to initialize handle\n");
+		FREE(t);
+		return NULL;
 	}
 
-finish:
-	yajl_free(yajl_hand);
-	curl_free(escaped);
-	FREE(parse_struct->aurpkg);
-	FREE(parse_struct);
-	FREE(url);
+	t->url = strdup(url);
+	t->label = strdup(label);
+	t->donefn = donefn;
+	t->queued = stats_now();
+
+	curl_easy_setopt(t->curl, CURLOPT_URL, t->url);
+	curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t);
 
-	return pkglist;
+	return t;
 } /* }}} */
 
-void *task_update(CURL *curl, void *arg) /* {{{ */
+int transfer_retry(struct transfer_t *t, CURLcode curlstat) /* {{{ */
 {
-	alpm_pkg_t *pmpkg;
-	struct aurpkg_t *aurpkg;
-	void *dlretval, *qretval;
-	const char *candidate = arg;
-
-	cwr_printf(LOG_VERBOSE, "Checking %s%s%s for updates...\n",
-			colstr->pkg, candidate, colstr->nc);
-
-	qretval = task_query(curl, arg);
-	aurpkg = qretval ? ((alpm_list_t*)qretval)->data : NULL;
-	if(aurpkg) {
+	struct transfer_t **tail;
+	double received = 0;
+	long httpcode = 0;
+	int transient;
+
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	transient = transfer_is_transient(curlstat, httpcode);
+	transfer_adjust(t, transient);
+	if(!transient || t->attempts >= RETRY_MAX) {
+		return 0;
+	}
 
-		pmpkg = alpm_db_get_pkg(db_local, arg);
+	/* whatever already made it to the parser or to libarchive can't be taken
+	 * back. error pages never get that far. */
+	if(curlstat != CURLE_OK) {
+#if LIBCURL_VERSION_NUM >= 0x073d00
+		curl_off_t bytes = 0;
+		curl_easy_getinfo(t->curl, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+		received = (double)bytes;
+#else
+		curl_easy_getinfo(t->curl, CURLINFO_SIZE_DOWNLOAD, &received);
+#endif
+	}
+	if(received > 0 || (t->extract && t->extract->started)) {
+		return 0;
+	}
 
-		if(!pmpkg) {
-			cwr_fprintf(stderr, LOG_WARN, "skipping uninstalled package %s\n",
-					candidate);
-			goto finish;
-		}
+	t->attempts++;
+	t->response.size = 0;
 
-		if(alpm_pkg_vercmp(aurpkg->ver, alpm_pkg_get_version(pmpkg)) > 0) {
-			if(alpm_list_find_str(cfg.ignore.pkgs, arg)) {
-				if(!cfg.quiet && !(cfg.logmask & LOG_BRIEF)) {
-					cwr_fprintf(stderr, LOG_WARN, "%s%s%s [ignored] %s%s%s -> %s%s%s\n",
-							colstr->pkg, candidate, colstr->nc,
-							colstr->ood, alpm_pkg_get_version(pmpkg), colstr->nc,
-							colstr->utd, aurpkg->ver, colstr->nc);
-				}
-				return NULL;
-			}
+	/* exponential backoff, spread out so that everything which failed together
+	 * doesn't come back together */
+	t->retry_at = clock_now() + RETRY_DELAY * (1 << (t->attempts - 1)) *
+		(0.5 + (double)rand() / RAND_MAX);
 
-			if(cfg.opmask & OP_DOWNLOAD) {
-				/* we don't care about the return, but we do care about leaks */
-				dlretval = task_download(curl, (void*)aurpkg->name);
-				alpm_list_free_inner(dlretval, aurpkg_free);
-				alpm_list_free(dlretval);
-			} else {
-				if(cfg.quiet) {
-					printf("%s%s%s\n", colstr->pkg, candidate, colstr->nc);
-				} else {
-					cwr_printf(LOG_INFO, "%s%s %s%s%s -> %s%s%s\n",
-							colstr->pkg, candidate,
-							colstr->ood, alpm_pkg_get_version(pmpkg), colstr->nc,
-							colstr->utd, aurpkg->ver, colstr->nc);
-				}
-			}
+	if(curlstat != CURLE_OK) {
+		cwr_printf(LOG_VERBOSE, "[%s]: %s, retrying (%d/%d)\n", t->label,
+				curl_easy_strerror(curlstat), t->attempts, RETRY_MAX);
+	} else {
+		cwr_printf(LOG_VERBOSE, "[%s]: server responded with %ld, retrying (%d/%d)\n",
+				t->label, httpcode, t->attempts, RETRY_MAX);
+	}
 
-			return qretval;
+	for(tail = &transfers.retry; *tail; tail = &(*tail)->next) {
+		if((*tail)->retry_at > t->retry_at) {
+			break;
 		}
 	}
+	t->next = *tail;
+	*tail = t;
 
-finish:
-	alpm_list_free_inner(qretval, aurpkg_free);
-	alpm_list_free(qretval);
-	return NULL;
+	return 1;
 } /* }}} */
 
-void *thread_pool(void *arg) /* {{{ */
+void transfer_share_lock(CURL UNUSED *curl, curl_lock_data UNUSED data, /* {{{ */
+		curl_lock_access UNUSED access, void UNUSED *userptr)
 {
-	alpm_list_t *ret = NULL;
-	CURL *curl;
-	void *job;
-	struct task_t *task;
+	/* every handle lives on the loop's thread, so there's never anyone to
+	 * wait for. this only counts how often curl goes to the share */
+	stats.sharelocks++;
+} /* }}} */
 
-	task = (struct task_t*)arg;
-	curl = curl_easy_init();
-	if(!curl) {
-		cwr_fprintf(stderr, LOG_ERROR, "curl: failed to initialize handle\n");
-		return NULL;
-	}
+void transfer_share_unlock(CURL UNUSED *curl, curl_lock_data UNUSED data, /* {{{ */
+		void UNUSED *userptr)
+{
+} /* }}} */
 
-	while(1) {
-		job = NULL;
+void transfer_start(struct transfer_t *t) /* {{{ */
+{
+	CURLMcode mstat;
 
-		/* try to pop off the work queue */
-		pthread_mutex_lock(&listlock);
-		if(workq) {
-			job = workq->data;
-			workq = alpm_list_next(workq);
+	/* too much on the wire. park this until something finishes */
+	if(transfers.inflight >= transfer_limit()) {
+		if(transfers.pending_tail) {
+			transfers.pending_tail->next = t;
+		} else {
+			transfers.pending = t;
 		}
-		pthread_mutex_unlock(&listlock);
+		transfers.pending_tail = t;
+		transfers.npending++;
+		return;
+	}
 
-		/* make sure we hooked a new job */
-		if(!job) {
-			break;
+	cwr_printf(LOG_DEBUG, "[%s]: curl_multi_add_handle %s\n", t->label, t->url);
+	mstat = curl_multi_add_handle(transfers.multi, t->curl);
+	if(mstat != CURLM_OK) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: %s\n", t->label, curl_multi_strerror(mstat));
+		t->donefn(t, CURLE_FAILED_INIT);
+		transfer_free(t);
+		return;
+	}
+
+	transfers.inflight++;
+	t->started = stats_now();
+	if(transfers.inflight > stats.peak) {
+		stats.peak = transfers.inflight;
+	}
+} /* }}} */
+
+void transfer_wake_drain(struct transfer_t *gone) /* {{{ */
+{
+	struct transfer_t *t;
+
+	/* every pointer in the pipe names a live transfer: one that's about to be
+	 * freed comes through here first, and skips its own wakeups */
+	while(read(transfers.wakefd[0], &t, sizeof(t)) == sizeof(t)) {
+		if(t != gone) {
+			curl_easy_pause(t->curl, CURLPAUSE_CONT);
 		}
+	}
+} /* }}} */
 
-		ret = alpm_list_join(ret, task->threadfn(curl, job));
+void transfer_wakeup(struct transfer_t *t) /* {{{ */
+{
+	/* writes this small to a pipe are atomic, so the loop always reads back
+	 * whole pointers */
+	if(write(transfers.wakefd[1], &t, sizeof(t)) != sizeof(t)) {
+		cwr_fprintf(stderr, LOG_ERROR, "[%s]: failed to resume transfer: %s\n",
+				t->label, strerror(errno));
 	}
+} /* }}} */
 
-	curl_easy_cleanup(curl);
+char unescape_char(char c) /* {{{ */
+{
+	switch(c) {
+		case '\\':
+			return '\\';
+		case '"':
+			return '\"';
+		case 'a':
+			return '\a';
+		case 'b':
+			return '\b';
+		case 'e': /* \e is nonstandard */
+			return '\033';
+		case 'n':
+			return '\n';
+		case 'r':
+			return '\r';
+		case 't':
+			return '\t';
+		case 'v':
+			return '\v';
+	}
 
-	return ret;
+	return '\0';
 } /* }}} */
 
 static char *url_escape(char *in, int len, const char *delim) /* {{{ */
@@ -2296,6 +6679,36 @@ static char *url_escape(char *in, int len, const char *delim) /* {{{ */
 	return strndup(buf, strlen(buf) - 1);
 } /* }}} */
 
+char *url_multiinfo(const alpm_list_t *targets) /* {{{ */
+{
+	const alpm_list_t *i;
+	char *url = NULL, *escaped;
+	size_t urlsz;
+	FILE *fp;
+
+	/* build the whole thing in one pass. large -u runs put hundreds of targets
+	 * in a single batch */
+	fp = open_memstream(&url, &urlsz);
+	if(!fp) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to build url: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	fprintf(fp, AUR_RPC_URL_MULTI, cfg.aururl);
+	for(i = targets; i; i = alpm_list_next(i)) {
+		escaped = url_escape(i->data, 0, NULL);
+		fprintf(fp, AUR_RPC_ARG_MULTI, escaped);
+		curl_free(escaped);
+	}
+
+	if(fclose(fp) != 0) {
+		cwr_fprintf(stderr, LOG_ERROR, "failed to build url: %s\n", strerror(errno));
+		FREE(url);
+	}
+
+	return url;
+} /* }}} */
+
 void usage(void) /* {{{ */
 {
 	fprintf(stderr, "cower %s\n"
@@ -2308,15 +6721,20 @@ void usage(void) /* {{{ */
 	                                 "more detail\n"
 	    "  -m, --msearch           show packages maintained by target(s)\n"
 	    "  -s, --search            search for target(s)\n"
+	    "      --sync-index        fetch all AUR package metadata for --offline\n"
+	    "      --daemon            answer other cower invocations from a warm process\n"
 	    "  -u, --update            check for updates against AUR -- can be combined "
 	                                 "with the -d flag\n\n");
 	fprintf(stderr, " General options:\n"
+	    "      --aur-url <url>     talk to the AUR at <url> instead of " AUR_URL_DEFAULT "\n"
+	    "      --cache-ttl <num>   cache RPC responses, trusting them for <num> seconds\n"
 	    "  -f, --force             overwrite existing files when downloading\n"
 	    "  -h, --help              display this help and exit\n"
 	    "      --ignore <pkg>      ignore a package upgrade (can be used more than once)\n"
 	    "      --ignorerepo <repo> ignore some or all binary repos\n"
+	    "      --offline           search the local package index instead of the AUR\n"
 	    "  -t, --target <dir>      specify an alternate download directory\n"
-	    "      --threads <num>     limit number of threads created\n"
+	    "      --threads <num>     limit number of concurrent connections\n"
 	    "      --timeout <num>     specify connection timeout in seconds\n"
 	    "  -V, --version           display version\n\n");
 	fprintf(stderr, " Output options:\n"
@@ -2327,7 +6745,11 @@ void usage(void) /* {{{ */
 	    "  -o, --ignore-ood        skip displaying out of date packages\n"
 	    "      --no-ignore-ood     the opposite of --ignore-ood\n"
 	    "      --listdelim <delim> change list format delimeter\n"
+	    "      --json              print results as JSON, one object per line\n"
+	    "  -0, --null              like --json, but end each object with a NUL\n"
 	    "  -q, --quiet             output less\n"
+	    "      --stats[=FORMAT]    report timings to stderr. FORMAT is `text' or `json'\n"
+	    "      --stream            print results as they arrive, unsorted\n"
 	    "  -v, --verbose           output more\n\n");
 } /* }}} */
 
@@ -2345,66 +6767,72 @@ void version(void) /* {{{ */
 	      "             Cower....\n\n", stdout);
 } /* }}} */
 
-size_t yajl_parse_stream(void *ptr, size_t size, size_t nmemb, void *stream) /* {{{ */
+alpm_list_t *workq_pop_batch(void) /* {{{ */
 {
-	struct yajl_handle_t *hand;
-	size_t realsize = size * nmemb;
+	alpm_list_t *batch = NULL;
+	size_t urlsz = strlen(cfg.aururl) + strlen(AUR_RPC_URL_MULTI);
 
-	hand = (struct yajl_handle_t*)stream;
-	yajl_parse(hand, ptr, realsize);
+	/* the escaped length of a target is at most 3 times its raw length, so
+	 * assume the worst and never exceed AUR_URL_MAX unless a single target is
+	 * already that long on its own. */
+	while(workq) {
+		size_t argsz = strlen(AUR_RPC_ARG_MULTI) + strlen(workq->data) * 3;
 
-	return realsize;
+		if(batch && urlsz + argsz > AUR_URL_MAX) {
+			break;
+		}
+
+		batch = alpm_list_add(batch, workq->data);
+		urlsz += argsz;
+		workq = alpm_list_next(workq);
+	}
+
+	return batch;
 } /* }}} */
 
-int read_targets_from_file(FILE *in, alpm_list_t **targets) { /* {{{ */
-	char line[BUFSIZ];
-	int i = 0, end = 0;
-	while(!end) {
-		line[i] = fgetc(in);
+void workq_push(char *target) /* {{{ */
+{
+	cfg.targets = alpm_list_add(cfg.targets, target);
 
-		if(line[i] == EOF) {
-			end = 1;
-		}
+	/* the queue is just a window onto the tail of cfg.targets. if it ran dry,
+	 * point it at the new entry */
+	if(!workq) {
+		workq = alpm_list_last(cfg.targets);
+	}
+} /* }}} */
 
-		if(isspace(line[i]) || end) {
-			line[i] = '\0';
-			/* avoid adding zero length arg, if multiple spaces separate args */
-			if(i > 0) {
-				if(!alpm_list_find_str(*targets, line)) {
-					cwr_printf(LOG_DEBUG, "adding target: %s\n", line);
-					*targets = alpm_list_add(*targets, strdup(line));
-				}
-				i = 0;
-			}
-		} else {
-			++i;
-			if(i >= BUFSIZ) {
-				cwr_fprintf(stderr, LOG_ERROR, "buffer overflow detected in stdin\n");
-				return -1;
-			}
-		}
+size_t yajl_parse_stream(void *ptr, size_t size, size_t nmemb, void *stream) /* {{{ */
+{
+	struct transfer_t *t = stream;
+	size_t realsize = size * nmemb;
+	double t0;
+	long httpcode;
+
+	/* a busy server's error page is going to be retried, not parsed */
+	curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &httpcode);
+	if(transfer_is_transient(CURLE_OK, httpcode)) {
+		return realsize;
 	}
 
-	return 0;
+	t0 = stats_now();
+	yajl_parse(t->yajl_hand, ptr, realsize);
+	stats_add(PHASE_JSON, t0);
+
+	/* hang on to the raw response so it can be cached */
+	if(t->cache) {
+		return curl_write_response(ptr, size, nmemb, t);
+	}
+
+	return realsize;
 } /* }}} */
 
 int main(int argc, char *argv[]) {
-	alpm_list_t *results = NULL, *thread_return = NULL;
-	int ret, n, num_threads;
-	pthread_attr_t attr;
-	pthread_t *threads;
-	struct task_t task = {
-		.printfn = NULL,
-		.threadfn = task_query
-	};
+	int ret;
 
 	setlocale(LC_ALL, "");
 
-	/* initialize config */
-	cfg.color = cfg.maxthreads = cfg.timeout = UNSET;
-	cfg.delim = LIST_DELIM;
-	cfg.logmask = LOG_ERROR|LOG_WARN|LOG_INFO;
-	cfg.ignoreood = UNSET;
+	config_init();
+	transfers.wakefd[0] = transfers.wakefd[1] = -1;
 
 	ret = parse_options(argc, argv);
 	switch(ret) {
@@ -2417,130 +6845,25 @@ int main(int argc, char *argv[]) {
 			return ret;
 	}
 
-	if((ret = parse_configfile() != 0)) {
-		return ret;
-	}
-
-	/* fallback from sentinel values */
-	cfg.maxthreads = cfg.maxthreads == UNSET ? THREAD_DEFAULT : cfg.maxthreads;
-	cfg.timeout = cfg.timeout == UNSET ? TIMEOUT_DEFAULT : cfg.timeout;
-	cfg.color = cfg.color == UNSET ? 0 : cfg.color;
-	cfg.ignoreood = cfg.ignoreood == UNSET ? 0 : cfg.ignoreood;
-
-	if((ret = strings_init()) != 0) {
-		return ret;
-	}
-
-	if((ret = set_working_dir()) != 0) {
-		goto finish;
-	}
-
-	if(cfg.frompkgbuild) {
-		/* treat arguments as filenames to load/extract */
-		cfg.targets = load_targets_from_files(cfg.targets);
-	} else if(alpm_list_find_str(cfg.targets, "-")) {
-		char *vdata;
-		cfg.targets = alpm_list_remove_str(cfg.targets, "-", &vdata);
-		free(vdata);
-		cwr_printf(LOG_DEBUG, "reading targets from stdin\n");
-		ret = read_targets_from_file(stdin, &cfg.targets);
-		if(ret != 0) {
-			goto finish;
-		}
-		if(!freopen(ctermid(NULL), "r", stdin)) {
-			cwr_printf(LOG_DEBUG, "failed to reopen stdin for reading\n");
-		}
-	}
-
-	cwr_printf(LOG_DEBUG, "initializing curl\n");
-	ret = curl_global_init(CURL_GLOBAL_ALL);
-	openssl_crypto_init();
-
-	if(ret != 0) {
-		cwr_fprintf(stderr, LOG_ERROR, "failed to initialize curl\n");
-		goto finish;
-	}
-
-	pmhandle = alpm_init();
-	if(!pmhandle) {
-		cwr_fprintf(stderr, LOG_ERROR, "failed to initialize alpm library\n");
-		goto finish;
-	}
-
-	/* allow specific updates to be provided instead of examining all foreign pkgs */
-	if((cfg.opmask & OP_UPDATE) && !cfg.targets) {
-		cfg.targets = alpm_find_foreign_pkgs();
-	}
-
-	workq = cfg.targets;
-	num_threads = alpm_list_count(cfg.targets);
-	if(num_threads == 0) {
-		fprintf(stderr, "error: no targets specified (use -h for help)\n");
-		goto finish;
-	} else if(num_threads > cfg.maxthreads) {
-		num_threads = cfg.maxthreads;
-	}
-
-	CALLOC(threads, num_threads, sizeof(pthread_t), goto finish);
-
-	pthread_attr_init(&attr);
-	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-
-	/* override task behavior */
-	if(cfg.opmask & OP_UPDATE) {
-		task.threadfn = task_update;
-	} else if(cfg.opmask & OP_INFO) {
-		task.printfn = cfg.format ? print_pkg_formatted : print_pkg_info;
-	} else if(cfg.opmask & (OP_SEARCH|OP_MSEARCH)) {
-		task.printfn = cfg.format ? print_pkg_formatted : print_pkg_search;
-	} else if(cfg.opmask & OP_DOWNLOAD) {
-		task.threadfn = task_download;
-	}
-
-	/* filthy, filthy hack: prepopulate the package cache */
-	alpm_db_get_pkgcache(db_local);
-
-	for(n = 0; n < num_threads; n++) {
-		ret = pthread_create(&threads[n], &attr, thread_pool, &task);
-		if(ret != 0) {
-			cwr_fprintf(stderr, LOG_ERROR, "failed to spawn new thread: %s\n",
-					strerror(ret));
-			return(ret); /* we don't want to recover from this */
+	if(cfg.opmask & OP_SERVE) {
+		ret = server_run();
+	} else if((ret = server_forward(argc, argv)) == SERVER_DECLINED) {
+		/* no daemon running, or not one that's able to answer for us */
+		if((ret = parse_configfile()) == 0) {
+			ret = request_run();
 		}
 	}
-
-	for(n = 0; n < num_threads; n++) {
-		pthread_join(threads[n], (void**)&thread_return);
-		results = alpm_list_join(results, thread_return);
-	}
-
-	free(threads);
-	pthread_attr_destroy(&attr);
-
-	/* we need to exit with a non-zero value when:
-	 * a) search/info/download returns nothing
-	 * b) update (without download) returns something
-	 * this is opposing behavior, so just XOR the result on a pure update */
-	results = filter_results(results);
-	ret = ((results == NULL) ^ !(cfg.opmask & ~OP_UPDATE));
-	print_results(results, task.printfn);
-	alpm_list_free_inner(results, aurpkg_free);
-	alpm_list_free(results);
-
-	openssl_crypto_cleanup();
-
-finish:
-	FREE(cfg.dlpath);
-	FREELIST(cfg.targets);
-	FREELIST(cfg.ignore.pkgs);
-	FREELIST(cfg.ignore.repos);
-	FREE(colstr);
+	request_free();
 
 	cwr_printf(LOG_DEBUG, "releasing curl\n");
+	transfer_cleanup();
 	curl_global_cleanup();
 
 	cwr_printf(LOG_DEBUG, "releasing alpm\n");
+	syncindex_free();
+	alpm_provides_free();
 	alpm_release(pmhandle);
+	strset_free(&pmignore);
 
 	return ret;
 }
@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# tarball-cache.sh - check that a paused download is cached intact
+#
+# usage: tarball-cache.sh [path to cower]
+#
+# Downloads a tarball big enough that extraction falls behind and curl has to
+# be paused, then compares the cached copy byte for byte with what the mock
+# AUR served. A second download has to extract from that cache.
+#
+
+cower=$(realpath "${1:-./cower}")
+topdir=$(dirname "$(realpath "$0")")/..
+pkg=bulk-0
+
+fail() {
+  printf 'FAIL: %s\n' "$*" >&2
+  exit 1
+}
+
+[[ -x $cower ]] || fail "$cower is not executable. build cower first"
+
+scratch=$(mktemp -d)
+trap 'kill $server 2>/dev/null; wait $server 2>/dev/null; rm -rf "$scratch"' EXIT
+
+python3 "$topdir/bench/mockaur.py" --port-file "$scratch/port" &
+server=$!
+
+for (( i = 0; i < 50; i++ )); do
+  [[ -s $scratch/port ]] && break
+  sleep 0.1
+done
+[[ -s $scratch/port ]] || fail 'mock server failed to start'
+aururl=http://127.0.0.1:$(<"$scratch/port")
+
+cower() {
+  HOME=$scratch XDG_CONFIG_HOME=$scratch/.config XDG_CACHE_HOME=$scratch/.cache \
+      XDG_RUNTIME_DIR=$scratch TMPDIR=$scratch \
+      "$cower" --aur-url "$aururl" --cache-ttl 0 -t "$scratch/dl" "$@"
+}
+
+mkdir -p "$scratch/dl"
+
+cower --debug -df "$pkg" >/dev/null 2>"$scratch/log" ||
+    fail "download of $pkg failed: $(tail -n 5 "$scratch/log")"
+grep -q 'pausing transfer' "$scratch/log" ||
+    fail 'extraction never fell behind. nothing was paused'
+
+cached=("$scratch"/.cache/cower/tarballs/*.tar.gz)
+(( ${#cached[@]} == 1 )) && [[ -f ${cached[0]} ]] ||
+    fail "expected one cached tarball, found: ${cached[*]}"
+
+python3 - "$aururl/packages/${pkg:0:2}/$pkg/$pkg.tar.gz" "$scratch/served.tar.gz" <<'EOF' ||
+import sys, urllib.request
+with urllib.request.urlopen(sys.argv[1]) as r, open(sys.argv[2], 'wb') as f:
+    f.write(r.read())
+EOF
+    fail 'failed to fetch the tarball from the mock server'
+
+cmp "$scratch/served.tar.gz" "${cached[0]}" ||
+    fail 'cached tarball differs from the one served'
+
+rm -rf "$scratch/dl/$pkg"
+cower --debug -df "$pkg" >/dev/null 2>"$scratch/log" ||
+    fail "download from the cache failed: $(tail -n 5 "$scratch/log")"
+grep -q 'extracting cached tarball' "$scratch/log" ||
+    fail 'second download did not use the cached tarball'
+[[ -f $scratch/dl/$pkg/bulk.bin ]] ||
+    fail 'nothing was extracted from the cached tarball'
+
+echo 'PASS: tarball-cache'